@@ -20,7 +20,9 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <map>
+#include <random>
 
 #include "SDL_gfxPrimitives.h"
 
@@ -29,30 +31,98 @@
 #include "move.hh"
 #include "square.hh"
 
+static int get_side(const Card * card, Direction direction)
+{
+	switch (direction)
+	{
+		case NORTH:
+			return card->top;
+
+		case SOUTH:
+			return card->bottom;
+
+		case EAST:
+			return card->right;
+
+		case WEST:
+			return card->left;
+	}
+
+	return 0;
+}
+
+static Direction get_opposite(Direction direction)
+{
+	switch (direction)
+	{
+		case NORTH:
+			return SOUTH;
+
+		case SOUTH:
+			return NORTH;
+
+		case EAST:
+			return WEST;
+
+		default:
+			return EAST;
+	}
+}
+
+static int get_element_bonus(const Square * square, const Card * card)
+{
+	if (square->element == ELEMENT_NONE)
+		return 0;
+
+	return square->element == card->element ? 1 : -1;
+}
+
 GameBoard::GameBoard(bool same, bool plus, bool same_wall, bool elemental, Piece first_piece, std::vector<Element> elements, std::vector<const Card *> cards) :
-	_current_piece(first_piece),
 	_same(same),
 	_plus(plus),
 	_same_wall(same_wall),
 	_elemental(elemental),
 	_cards(cards),
 	_moves(9 * 10),
-	_squares_to_cards(9),
-	_owners(10),
-	_played_cards(10, false),
-	_move_history(),
-	_card_history()
+	_position(),
+	_dealt_owners(0),
+	_symmetries(),
+	_history(),
+	_history_size(0),
+	_placement_keys(9 * 10),
+	_owner_keys(9),
+	_piece_keys(2)
 {
 	this->_squares = Square::build_squares(3, 3, elements);
 
+	// Zobrist keys are generated from a fixed seed so that every board built
+	// from the same deal hashes its positions identically.
+	std::mt19937_64 generator(0x54726970);
+
+	for (auto iter = this->_placement_keys.begin(); iter != this->_placement_keys.end(); iter++)
+		*iter = generator();
+
+	for (auto iter = this->_owner_keys.begin(); iter != this->_owner_keys.end(); iter++)
+		*iter = generator();
+
+	for (auto iter = this->_piece_keys.begin(); iter != this->_piece_keys.end(); iter++)
+		*iter = generator();
+
+	this->_position.key = this->_piece_keys[first_piece];
+	this->_position.current_piece = first_piece;
+
 	for (size_t i = 0; i < cards.size(); i++)
 	{
 		this->_cards[i] = cards[i];
 
-		Piece owner = i < 5 ? PIECE_BLUE : PIECE_RED;
-		this->_owners[cards[i]->id] = owner;
+		if (i < 5)
+			this->_position.owners |= 1 << cards[i]->id;
 	}
 
+	this->_dealt_owners = this->_position.owners;
+
+	this->_position.difference = 2 * __builtin_popcount(this->_position.owners) - static_cast<int>(cards.size());
+
 	for (auto card = this->_cards.begin(); card != this->_cards.end(); card++)
 	{
 		for (auto square = this->_squares.begin(); square != this->_squares.end(); square++)
@@ -60,22 +130,76 @@ GameBoard::GameBoard(bool same, bool plus, bool same_wall, bool elemental, Piece
 			this->_moves[(*card)->id * 9 + (*square)->id] = new Move(*square, *card);
 		}
 	}
+
+	this->_build_rule_tables();
+	this->_build_symmetries();
+
+	// The rules never change during a game, so the move code for them is
+	// picked once here. Elements only affect the rule tables.
+	static const MoveFunction move_functions[] = {
+		&GameBoard::_apply<false, false, false>,
+		&GameBoard::_apply<false, false, true>,
+		&GameBoard::_apply<false, true, false>,
+		&GameBoard::_apply<false, true, true>,
+		&GameBoard::_apply<true, false, false>,
+		&GameBoard::_apply<true, false, true>,
+		&GameBoard::_apply<true, true, false>,
+		&GameBoard::_apply<true, true, true>
+	};
+
+	this->_move_function = move_functions[same * 4 + plus * 2 + same_wall];
 }
 
 GameBoard::GameBoard(const GameBoard & board) :
-	_current_piece(board._current_piece),
 	_same(board._same),
 	_plus(board._plus),
 	_same_wall(board._same_wall),
 	_elemental(board._elemental),
 	_cards(board._cards),
+	_squares(board._squares),
 	_moves(board._moves),
-	_squares_to_cards(board._squares_to_cards),
-	_owners(board._owners),
-	_played_cards(board._played_cards),
-	_move_history(),
-	_card_history()
-{ }
+	_position(board._position),
+	_dealt_owners(board._dealt_owners),
+	_symmetries(board._symmetries),
+	_history(),
+	_history_size(0),
+	_placement_keys(board._placement_keys),
+	_owner_keys(board._owner_keys),
+	_piece_keys(board._piece_keys),
+	_move_function(board._move_function)
+{
+	std::copy(&board._neighbors[0][0], &board._neighbors[0][0] + 9 * 4, &this->_neighbors[0][0]);
+	std::copy(board._walls, board._walls + 9, this->_walls);
+	std::copy(board._classes, board._classes + 10, this->_classes);
+	std::copy(board._twins, board._twins + 10, this->_twins);
+	std::copy(&board._beat_masks[0][0][0], &board._beat_masks[0][0][0] + 10 * 9 * 4, &this->_beat_masks[0][0][0]);
+	std::copy(&board._same_masks[0][0], &board._same_masks[0][0] + 10 * 4, &this->_same_masks[0][0]);
+	std::copy(&board._plus_sums[0][0][0], &board._plus_sums[0][0][0] + 10 * 4 * 10, &this->_plus_sums[0][0][0]);
+}
+
+inline const Card * GameBoard::_get_card(const Position & position, int square) const
+{
+	return position.occupied >> square & 1 ? this->_cards[position.squares_to_cards[square]] : NULL;
+}
+
+inline Piece GameBoard::_get_owner(const Position & position, int card) const
+{
+	return position.owners >> card & 1 ? PIECE_BLUE : PIECE_RED;
+}
+
+inline unsigned int GameBoard::_get_cards(const Position & position, Piece piece) const
+{
+	return piece == PIECE_BLUE ? position.owners : ~position.owners & 0x3FF;
+}
+
+inline void GameBoard::_flip(Position & position, int square) const
+{
+	int card = position.squares_to_cards[square];
+
+	position.owners ^= 1 << card;
+	position.difference += position.owners >> card & 1 ? 2 : -2;
+	position.key ^= this->_owner_keys[square];
+}
 
 void GameBoard::move(const Move * const move)
 {
@@ -85,169 +209,431 @@ void GameBoard::move(const Move * const move)
 		exit(1);
 	}
 
-	this->_squares_to_cards[move->square->id] = move->card;
-	this->_played_cards[move->card->id] = true;
-	this->_card_history.push(move->card);
+	this->_history[this->_history_size++] = move;
 
-	if (this->_same || this->_plus)
+	(this->*_move_function)(this->_position, move);
+}
+
+const Position & GameBoard::get_position() const
+{
+	return this->_position;
+}
+
+Position GameBoard::apply(const Position & position, const Move * move) const
+{
+	Position child = position;
+
+	(this->*_move_function)(child, move);
+
+	return child;
+}
+
+template <bool SAME, bool PLUS, bool SAME_WALL>
+void GameBoard::_apply(Position & position, const Move * const move) const
+{
+	position.occupied |= 1 << move->square->id;
+	position.played |= 1 << move->card->id;
+	position.squares_to_cards[move->square->id] = move->card->id;
+	position.key ^= this->_placement_keys[this->_classes[move->card->id] * 9 + move->square->id];
+
+	unsigned int flips = this->_get_captures(position, move->card->id, move->square->id);
+	bool combo = false;
+
+	if (SAME || PLUS)
 	{
-		bool north = false, south = false, east = false, west = false;
-		bool combo = false;
+		// Both rules look at all four sides at once and give the directions
+		// whose neighbors they take.
+		unsigned int taken = 0;
 
-		if (this->_same)
+		if (SAME)
+			taken |= this->_check_same<SAME_WALL>(position, move->card->id, move->square->id);
+
+		if (PLUS)
+			taken |= this->_check_plus(position, move->card->id, move->square->id);
+
+		combo = taken != 0;
+
+		// Cards taken by same or plus flip whatever their neighbors beat, and so
+		// on down the line. Once there is a combo, so do the cards the placed
+		// card takes by the basic rule. A wall taken by same leads back to the
+		// placed card, which is never flipped.
+		for (; taken; taken &= taken - 1)
+		{
+			int target = this->_neighbors[move->square->id][__builtin_ctz(taken)];
+
+			if (this->_get_owner(position, position.squares_to_cards[target]) != position.current_piece)
+				flips |= 1 << target;
+		}
+	}
+
+	unsigned int frontier = combo ? flips : 0;
+
+	while (true)
+	{
+		for (unsigned int squares = flips; squares; squares &= squares - 1)
 		{
-			bool north_same = this->_check_same(move->square, NORTH);
-			bool south_same = this->_check_same(move->square, SOUTH);
-			bool west_same = this->_check_same(move->square, WEST);
-			bool east_same = this->_check_same(move->square, EAST);
+			this->_flip(position, __builtin_ctz(squares));
+		}
 
-			if (north_same && east_same)
-				north = east = true;
+		if (!frontier)
+			break;
 
-			if (north_same && south_same)
-				north = south = true;
+		int square = __builtin_ctz(frontier);
+		frontier &= frontier - 1;
 
-			if (north_same && west_same)
-				north = west = true;
+		flips = this->_get_captures(position, position.squares_to_cards[square], square);
+		frontier |= flips;
+	}
 
-			if (east_same && west_same)
-				east = west = true;
+	position.key ^= this->_piece_keys[PIECE_RED] ^ this->_piece_keys[PIECE_BLUE];
+	position.current_piece = position.current_piece == PIECE_BLUE ? PIECE_RED : PIECE_BLUE;
+}
 
-			if (east_same && south_same)
-				east = south = true;
+Piece GameBoard::get_current_piece()
+{
+	return this->_position.current_piece;
+}
 
-			if (west_same && south_same)
-				west = south = true;
+int GameBoard::get_score(Piece piece)
+{
+	return (static_cast<int>(this->_cards.size()) + this->get_score_difference(piece)) / 2;
+}
 
-			if (north || south || east || west)
-				combo = true;
-		}
+int GameBoard::get_score_difference(Piece piece)
+{
+	return this->get_score_difference(this->_position, piece);
+}
+
+int GameBoard::get_score_difference(const Position & position, Piece piece) const
+{
+	return piece == PIECE_BLUE ? position.difference : -position.difference;
+}
+
+int GameBoard::get_score_difference(const Position & position, const Move * move, Piece piece) const
+{
+	if (this->_same || this->_plus)
+	{
+		unsigned int taken = 0;
+
+		if (this->_same)
+			taken |= this->_same_wall ? this->_check_same<true>(position, move->card->id, move->square->id) : this->_check_same<false>(position, move->card->id, move->square->id);
 
 		if (this->_plus)
-		{
-			int north_value = this->_check_plus(move->square, NORTH);
-			int south_value = this->_check_plus(move->square, SOUTH);
-			int east_value = this->_check_plus(move->square, EAST);
-			int west_value = this->_check_plus(move->square, WEST);
+			taken |= this->_check_plus(position, move->card->id, move->square->id);
 
-			if (north_value > 0 && north_value == east_value)
-				north = east = true;
+		if (taken)
+			return this->get_score_difference(this->apply(position, move), piece);
+	}
 
-			if (east_value > 0 && east_value == south_value)
-				east = south = true;
+	// Without a combo, only the cards the placed card beats change hands.
+	int flips = __builtin_popcount(this->_get_captures(position, move->card->id, move->square->id));
+	int difference = this->get_score_difference(position, piece);
 
-			if (south_value > 0 && south_value == west_value)
-				south = west = true;
+	return position.current_piece == piece ? difference + 2 * flips : difference - 2 * flips;
+}
 
-			if (west_value > 0 && west_value == north_value)
-				west = north = true;
+void GameBoard::get_score_bounds(Piece piece, int & lower, int & upper)
+{
+	this->get_score_bounds(this->_position, piece, lower, upper);
+}
 
-			if (north_value > 0 && north_value == south_value)
-				north = south = true;
+void GameBoard::get_score_bounds(const Position & position, Piece piece, int & lower, int & upper) const
+{
+	static const Direction directions[] = { NORTH, SOUTH, EAST, WEST };
 
-			if (east_value > 0 && east_value == west_value)
-				east = west = true;
+	Piece other = position.current_piece == PIECE_BLUE ? PIECE_RED : PIECE_BLUE;
+	int difference = this->get_score_difference(position, piece);
 
-			if (north || south || east || west)
-				combo = true;
-		}
+	// The next move can only flip cards owned by the other player. Without
+	// same or plus, those must also be next to the square it is played on, and
+	// no later move can flip more cards than the most neighbors an empty square
+	// has.
+	int occupied = 0, targets = 0, next_flips = 0, reach = 0;
 
-		if (north) {
-			this->_execute_basic(move->square->get_neighbor(NORTH), true);
-		} else if (this->_execute_flip(move->square, NORTH) && combo) {
-			this->_execute_basic(move->square->get_neighbor(NORTH), false);
-		}
-		
-		if (south) {
-			this->_execute_basic(move->square->get_neighbor(SOUTH), true);
-		} else if (this->_execute_flip(move->square, SOUTH) && combo) {
-			this->_execute_basic(move->square->get_neighbor(SOUTH), false);
+	for (auto square = this->_squares.begin(); square != this->_squares.end(); square++)
+	{
+		const Card * card = this->_get_card(position, (*square)->id);
+
+		if (card)
+		{
+			occupied++;
+
+			if (this->_get_owner(position, card->id) == other)
+				targets++;
+
+			continue;
 		}
-		
-		if (east) {
-			this->_execute_basic(move->square->get_neighbor(EAST), true);
-		} else if (this->_execute_flip(move->square, EAST) && combo) {
-			this->_execute_basic(move->square->get_neighbor(EAST), false);
+
+		int neighbors = 0, flips = 0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			const Square * neighbor = (*square)->get_neighbor(directions[i]);
+
+			if (!neighbor)
+				continue;
+
+			neighbors++;
+
+			const Card * neighbor_card = this->_get_card(position, neighbor->id);
+
+			if (neighbor_card && this->_get_owner(position, neighbor_card->id) == other)
+				flips++;
 		}
-		
-		if (west) {
-			this->_execute_basic(move->square->get_neighbor(WEST), true);
-		} else if (this->_execute_flip(move->square, WEST) && combo) {
-			this->_execute_basic(move->square->get_neighbor(WEST), false);
-		}		
-	} else {
-		this->_execute_flip(move->square, NORTH);
-		this->_execute_flip(move->square, SOUTH);
-		this->_execute_flip(move->square, EAST);
-		this->_execute_flip(move->square, WEST);
+
+		next_flips = std::max(next_flips, flips);
+		reach = std::max(reach, neighbors);
+	}
+
+	bool combos = this->_same || this->_plus;
+
+	if (combos)
+		next_flips = targets;
+
+	lower = upper = difference;
+
+	// Every flip moves the difference by two. With same or plus, a combo can
+	// reach any card on the board.
+	Piece current = position.current_piece;
+
+	for (int squares = occupied; squares < 9; squares++)
+	{
+		int flips = squares == occupied ? next_flips : combos ? squares : std::min(squares, reach);
+
+		if (current == piece)
+			upper += 2 * flips;
+		else
+			lower -= 2 * flips;
+
+		current = current == PIECE_BLUE ? PIECE_RED : PIECE_BLUE;
 	}
+}
 
-	this->_move_history.push(move);
+int GameBoard::get_empty_square_count()
+{
+	return this->get_empty_square_count(this->_position);
+}
+
+int GameBoard::get_empty_square_count(const Position & position) const
+{
+	return 9 - __builtin_popcount(position.occupied);
+}
 
-	this->_current_piece = this->_current_piece == PIECE_BLUE ? PIECE_RED : PIECE_BLUE;
+unsigned long long GameBoard::get_key()
+{
+	return this->_position.key;
 }
 
-void GameBoard::unmove()
+unsigned long long GameBoard::get_canonical_key(const Position & position, int & symmetry) const
 {
-	const Move * move = this->_move_history.top();
-	this->_move_history.pop();
+	unsigned long long best = position.key;
+	symmetry = 0;
+
+	// Only the squares move, so each image's key differs from the position's
+	// by the placement and flip keys of the squares that change.
+	unsigned int flipped = position.owners ^ this->_dealt_owners;
 
-	for (const Card * card = this->_card_history.top(); card != move->card; card = this->_card_history.top())
+	for (size_t i = 1; i < this->_symmetries.size(); i++)
 	{
-		this->_owners[card->id] = this->_owners[card->id] == PIECE_BLUE ? PIECE_RED : PIECE_BLUE;
-		this->_card_history.pop();
+		unsigned long long key = position.key;
+
+		for (unsigned int squares = position.occupied; squares; squares &= squares - 1)
+		{
+			int square = __builtin_ctz(squares);
+			int image = this->_symmetries[i].squares[square];
+			int card = position.squares_to_cards[square];
+			int card_class = this->_classes[card];
+
+			key ^= this->_placement_keys[card_class * 9 + square] ^ this->_placement_keys[card_class * 9 + image];
+
+			if (flipped >> card & 1)
+				key ^= this->_owner_keys[square] ^ this->_owner_keys[image];
+		}
+
+		if (key < best)
+		{
+			best = key;
+			symmetry = i;
+		}
 	}
 
-	this->_squares_to_cards[move->square->id] = NULL;
-	this->_played_cards[move->card->id] = false;
+	return best;
+}
 
-	this->_card_history.pop();
+unsigned long long GameBoard::get_canonical_code(const Position & position) const
+{
+	int symmetry;
+	this->get_canonical_key(position, symmetry);
 
-	this->_current_piece = this->_current_piece == PIECE_BLUE ? PIECE_RED : PIECE_BLUE;
+	return this->get_canonical_code(position, symmetry);
 }
 
-Piece GameBoard::get_current_piece()
+unsigned long long GameBoard::get_canonical_code(const Position & position, int symmetry) const
 {
-	return this->_current_piece;
+	const Symmetry & image = this->_symmetries[symmetry];
+
+	// Five bits for each square of the image: zero when it is empty, otherwise
+	// the class of the card on it and whether blue owns it. Which cards are
+	// still in hand follows from those, so with the piece to move, that is the
+	// whole position.
+	unsigned long long code = position.current_piece;
+
+	for (int square = 8; square >= 0; square--)
+	{
+		int original = image.inverse[square];
+
+		code <<= 5;
+
+		if (position.occupied >> original & 1)
+		{
+			int card = position.squares_to_cards[original];
+			code |= 1 + this->_classes[card] * 2 + (position.owners >> card & 1);
+		}
+	}
+
+	return code;
 }
 
-int GameBoard::get_score(Piece piece)
+Position GameBoard::get_position(unsigned long long code) const
 {
-	int count = 0;
+	Position position = Position();
 
-	for (auto iter = this->_cards.begin(); iter != this->_cards.end(); iter++)
+	position.owners = this->_dealt_owners;
+	position.current_piece = static_cast<Piece>(code >> 45);
+	position.key = this->_piece_keys[position.current_piece];
+
+	for (int square = 0; square < 9; square++, code >>= 5)
 	{
-		if (this->_owners[(*iter)->id] == piece)
-			count++;
+		int value = code & 0x1F;
+
+		if (value == 0)
+			continue;
+
+		int card_class = (value - 1) / 2;
+		int card = card_class;
+
+		while (this->_classes[card] != card_class || (position.played >> card & 1))
+			card++;
+
+		position.occupied |= 1 << square;
+		position.played |= 1 << card;
+		position.squares_to_cards[square] = card;
+		position.key ^= this->_placement_keys[card_class * 9 + square];
+
+		if ((value - 1) % 2 != (this->_dealt_owners >> card & 1))
+		{
+			position.owners ^= 1 << card;
+			position.key ^= this->_owner_keys[square];
+		}
 	}
 
-	return count;
+	position.difference = 2 * __builtin_popcount(position.owners) - static_cast<int>(this->_cards.size());
+
+	return position;
+}
+
+const Move * GameBoard::get_canonical_move(const Move * move, int symmetry) const
+{
+	return this->_moves[move->card->id * 9 + this->_symmetries[symmetry].squares[move->square->id]];
+}
+
+const Move * GameBoard::get_original_move(const Move * move, int symmetry) const
+{
+	return this->_moves[move->card->id * 9 + this->_symmetries[symmetry].inverse[move->square->id]];
 }
 
 bool GameBoard::is_valid_move(const Move * move)
 {
-	return (!this->_squares_to_cards[move->square->id] && this->_owners[move->card->id] == this->_current_piece);
+	return !(this->_position.occupied >> move->square->id & 1) && !(this->_position.played >> move->card->id & 1) && this->_get_owner(this->_position, move->card->id) == this->_position.current_piece;
 }
 
-std::list<const Move *> GameBoard::get_valid_moves()
+MoveList GameBoard::get_valid_moves()
 {
-	std::list<const Move *> moves;
-	
-	for (auto card = this->_cards.begin(); card != this->_cards.end(); card++)
+	return this->get_valid_moves(this->_position);
+}
+
+MoveList GameBoard::get_valid_moves(const Position & position) const
+{
+	MoveList moves;
+
+	unsigned int hand = this->_get_cards(position, position.current_piece) & ~position.played;
+	unsigned int empty = ~position.occupied & 0x1FF;
+
+	for (unsigned int cards = hand; cards; cards &= cards - 1)
+	{
+		int card = __builtin_ctz(cards);
+
+		if (hand & this->_twins[card])
+			hand &= ~(1 << card);
+	}
+
+	for (unsigned int cards = hand; cards; cards &= cards - 1)
+	{
+		int card = __builtin_ctz(cards);
+
+		for (unsigned int squares = empty; squares; squares &= squares - 1)
+			moves.push_back(this->_moves[card * 9 + __builtin_ctz(squares)]);
+	}
+
+	return moves;
+}
+
+MoveList GameBoard::get_distinct_moves(const Position & position) const
+{
+	MoveList moves = this->get_valid_moves(position);
+
+	if (this->_symmetries.size() == 1)
+		return moves;
+
+	// The symmetries that map every card on the board onto itself or a twin
+	// with the same owner, such as all of them on the empty board.
+	std::vector<const Symmetry *> symmetries;
+
+	for (auto symmetry = this->_symmetries.begin() + 1; symmetry != this->_symmetries.end(); symmetry++)
 	{
-		if (this->_owners[(*card)->id] == this->_current_piece && !this->_played_cards[(*card)->id])
+		bool fixed = true;
+
+		for (unsigned int squares = position.occupied; squares && fixed; squares &= squares - 1)
 		{
-			for (auto square = this->_squares.begin(); square != this->_squares.end(); square++)
-			{
-				if (!this->_squares_to_cards[(*square)->id])
-				{
-					moves.push_back(this->_moves[(*card)->id * 9 + (*square)->id]);
-				}
-			}
+			int square = __builtin_ctz(squares);
+			int image = symmetry->squares[square];
+
+			int card = position.squares_to_cards[square];
+			int image_card = position.squares_to_cards[image];
+
+			fixed = (position.occupied >> image & 1) && this->_classes[image_card] == this->_classes[card] && (position.owners >> image_card & 1) == (position.owners >> card & 1);
 		}
+
+		if (fixed)
+			symmetries.push_back(&*symmetry);
 	}
 
-	return moves;
+	// Moves come ordered by index, so keeping only the lowest index of each
+	// set of mirrored moves keeps the first of them.
+	MoveList distinct;
+
+	for (auto move = moves.begin(); move != moves.end(); move++)
+	{
+		bool first = true;
+
+		for (auto symmetry = symmetries.begin(); symmetry != symmetries.end() && first; symmetry++)
+			first = (*symmetry)->squares[(*move)->square->id] >= (*move)->square->id;
+
+		if (first)
+			distinct.push_back(*move);
+	}
+
+	return distinct;
+}
+
+int GameBoard::get_flip_count(const Move * move)
+{
+	return this->get_flip_count(this->_position, move);
+}
+
+int GameBoard::get_flip_count(const Position & position, const Move * move) const
+{
+	return __builtin_popcount(this->_get_captures(position, move->card->id, move->square->id));
 }
 
 const Move * GameBoard::get_move(const Card * card, int row, int col)
@@ -257,6 +643,16 @@ const Move * GameBoard::get_move(const Card * card, int row, int col)
 	return this->_moves[card->id * 9 + square->id];
 }
 
+const Move * GameBoard::get_move(int index) const
+{
+	return this->_moves[index];
+}
+
+int GameBoard::get_move_index(const Move * move) const
+{
+	return move->card->id * 9 + move->square->id;
+}
+
 void GameBoard::render(SDL_Surface * surface)
 {
 	boxRGBA(surface, 0, 0, 523, 434, 128, 64, 0, 255);
@@ -271,8 +667,8 @@ void GameBoard::render(SDL_Surface * surface)
 			int row_offset = 121 + (row + 1) + row * 100;
 
 			const Move * last_move = NULL;
-			if (!this->_move_history.empty())
-				last_move = this->_move_history.top();
+			if (this->_history_size > 0)
+				last_move = this->_history[this->_history_size - 1];
 
 			if (last_move && last_move->square->row == row && last_move->square->col == col)
 				boxRGBA(surface, col_offset, row_offset, col_offset + 99, row_offset + 99, 128, 128, 128, 255);
@@ -320,11 +716,11 @@ void GameBoard::render(SDL_Surface * surface)
 			}
 			}
 
-			const Card * card = this->_squares_to_cards[this->_squares[row * 3 + col]->id];
+			const Card * card = this->_get_card(this->_position, this->_squares[row * 3 + col]->id);
 
 			if (card)
 			{
-				switch(this->_owners[card->id])
+				switch(this->_get_owner(this->_position, card->id))
 				{
 					case PIECE_BLUE:
 						boxRGBA(surface, col_offset + 5, row_offset + 20, col_offset + 5 + 89, row_offset + 20 + 74, 0, 0, 0, 255);
@@ -345,8 +741,8 @@ void GameBoard::render(SDL_Surface * surface)
 
 			int elemental_adjustment = 0;
 
-			if (this->_squares[row * 3 + col]->element != ELEMENT_NONE && this->_squares_to_cards[this->_squares[row * 3 + col]->id])
-				elemental_adjustment += this->_squares[row * 3 + col]->element == this->_squares_to_cards[this->_squares[row * 3 + col]->id]->element ? 1 : -1;
+			if (this->_squares[row * 3 + col]->element != ELEMENT_NONE && this->_get_card(this->_position, this->_squares[row * 3 + col]->id))
+				elemental_adjustment += this->_squares[row * 3 + col]->element == this->_get_card(this->_position, this->_squares[row * 3 + col]->id)->element ? 1 : -1;
 
 			if (this->_elemental)
 			{
@@ -368,7 +764,7 @@ void GameBoard::render(SDL_Surface * surface)
 
 	for (int i = 0; i < 10; i++)
 	{
-		if (!this->_played_cards[this->_cards[i]->id])
+		if (!(this->_position.played >> this->_cards[i]->id & 1))
 		{
 			if (i < 5)
 			{
@@ -399,168 +795,215 @@ void GameBoard::render(SDL_Surface * surface)
 	}
 }
 
-void GameBoard::_execute_basic(const Square * square, bool check)
+unsigned int GameBoard::_get_captures(const Position & position, int card, int square) const
 {
-//	if (square && (!check || this->_owners[this->_squares_to_cards[square->id]->id] != this->_current_piece))
-	if (square && (!check || this->_owners[this->_squares_to_cards[square->id]->id] != this->_current_piece))
+	// The four sides are handled alike and without branches. Beat masks are
+	// empty at the edge of the board, where the neighbor is the square itself.
+	unsigned int enemies = position.current_piece == PIECE_BLUE ? ~position.owners : position.owners;
+	unsigned int captures = 0;
+
+	for (int direction = NORTH; direction <= WEST; direction++)
 	{
-		const Card * target_card = this->_squares_to_cards[square->id];
+		int target = this->_neighbors[square][direction];
+		unsigned int beaten = this->_beat_masks[card][square][direction] & enemies;
 
-		if (this->_owners[target_card->id] != this->_current_piece)
-		{
-			this->_card_history.push(target_card);
-			this->_owners[target_card->id] = this->_current_piece;
-		}
+		captures |= (beaten >> position.squares_to_cards[target] & position.occupied >> target & 1) << target;
+	}
 
-		if (this->_execute_flip(square, NORTH))
-			this->_execute_basic(square->get_neighbor(NORTH), false);
+	return captures;
+}
+
+// A byte lane of 0x80 for every byte of the word that is zero. Unlike the
+// usual trick, no carry can spill from one lane into the next.
+static inline unsigned int get_zero_lanes(unsigned int word)
+{
+	return ~(((word & 0x7F7F7F7F) + 0x7F7F7F7F) | word) & 0x80808080;
+}
 
-		if (this->_execute_flip(square, SOUTH))
-			this->_execute_basic(square->get_neighbor(SOUTH), false);
+// Packs the top bit of each byte lane into the low four bits, lane zero first.
+static inline unsigned int get_lane_mask(unsigned int lanes)
+{
+	return ((lanes >> 7) * 0x00204081) >> 21 & 0xF;
+}
 
-		if (this->_execute_flip(square, EAST))
-			this->_execute_basic(square->get_neighbor(EAST), false);
+unsigned int GameBoard::_check_plus(const Position & position, int card, int square) const
+{
+	// One byte lane per direction holds the sum of the facing sides, or zero
+	// without a neighbor. Rotating the word lines every lane up with each of
+	// the other three, so all six pairs are compared in three steps.
+	unsigned int sums = 0;
 
-		if (this->_execute_flip(square, WEST))
-			this->_execute_basic(square->get_neighbor(WEST), false);
+	for (int direction = NORTH; direction <= WEST; direction++)
+	{
+		int target = this->_neighbors[square][direction];
+		unsigned int present = (position.occupied >> target & ~this->_walls[square] >> direction) & 1;
+
+		sums |= (this->_plus_sums[card][direction][position.squares_to_cards[target]] & -present) << (direction * 8);
 	}
+
+	unsigned int matches = 0;
+
+	for (int shift = 8; shift < 32; shift += 8)
+		matches |= get_zero_lanes(sums ^ (sums << shift | sums >> (32 - shift)));
+
+	return get_lane_mask(matches & ~get_zero_lanes(sums));
 }
 
-bool GameBoard::_execute_flip(const Square * square, Direction direction)
+template <bool SAME_WALL>
+unsigned int GameBoard::_check_same(const Position & position, int card, int square) const
 {
-	const Square * target = square->get_neighbor(direction);
+	// Bit ten of a mask stands for the wall.
+	unsigned int same = 0;
 
-	if (!target)
-		return false;
+	for (int direction = NORTH; direction <= WEST; direction++)
+	{
+		int target = this->_neighbors[square][direction];
+		unsigned int wall = this->_walls[square] >> direction & 1;
+		unsigned int mask = this->_same_masks[card][direction];
 
-	const Card * card = this->_squares_to_cards[square->id];
-	const Card * target_card = this->_squares_to_cards[target->id];
+		if (wall)
+			same |= (SAME_WALL && mask >> 10 & 1) << direction;
+		else
+			same |= (mask >> position.squares_to_cards[target] & position.occupied >> target & 1) << direction;
+	}
+
+	// Any two matching sides make a same, and then every matching side counts.
+	return same & (same - 1) ? same : 0;
+}
 
-	if (!target_card)
-		return false;
+void GameBoard::_build_rule_tables()
+{
+	static const Direction directions[] = { NORTH, SOUTH, EAST, WEST };
 
-	if (this->_owners[target_card->id] != this->_current_piece)
+	for (auto square = this->_squares.begin(); square != this->_squares.end(); square++)
 	{
-		int score = 0;
+		this->_walls[(*square)->id] = 0;
 
-		switch (direction)
+		for (int i = 0; i < 4; i++)
 		{
-			case NORTH:
-				score += card->top;
-				score -= target_card->bottom;
-				break;
-
-			case SOUTH:
-				score += card->bottom;
-				score -= target_card->top;
-				break;
-
-			case EAST:
-				score += card->right;
-				score -= target_card->left;
-				break;
-
-			case WEST:
-				score += card->left;
-				score -= target_card->right;
-				break;
+			const Square * neighbor = (*square)->get_neighbor(directions[i]);
+			this->_neighbors[(*square)->id][directions[i]] = neighbor ? neighbor->id : (*square)->id;
+
+			if (!neighbor)
+				this->_walls[(*square)->id] |= 1 << directions[i];
 		}
+	}
 
-		if (this->_elemental)
-		{
-			if (square->element != ELEMENT_NONE)
-				score += square->element == card->element ? 1 : -1;
+	for (auto card = this->_cards.begin(); card != this->_cards.end(); card++)
+	{
+		int id = (*card)->id;
 
-			if (target->element != ELEMENT_NONE)
-				score -= target->element == target_card->element ? 1 : -1;
-		}
+		this->_classes[id] = id;
+		this->_twins[id] = 0;
 
-		if (score > 0)
+		for (auto twin = this->_cards.begin(); twin != this->_cards.end(); twin++)
 		{
-			this->_card_history.push(target_card);
-			this->_owners[target_card->id] = this->_current_piece;
-			return true;
+			if ((*twin)->id >= id || (this->_dealt_owners >> (*twin)->id & 1) != (this->_dealt_owners >> id & 1))
+				continue;
+
+			if ((*twin)->top != (*card)->top || (*twin)->bottom != (*card)->bottom || (*twin)->left != (*card)->left || (*twin)->right != (*card)->right)
+				continue;
+
+			if (this->_elemental && (*twin)->element != (*card)->element)
+				continue;
+
+			this->_classes[id] = std::min(this->_classes[id], static_cast<unsigned char>((*twin)->id));
+			this->_twins[id] |= 1 << (*twin)->id;
 		}
 
-	}
+		for (int i = 0; i < 4; i++)
+		{
+			Direction direction = directions[i];
+			int side = get_side(*card, direction);
 
-	return false;
-}
+			this->_same_masks[(*card)->id][direction] = side == 10 ? 1 << 10 : 0;
 
-int GameBoard::_check_plus(const Square * square, Direction direction)
-{
-	const Card * card = this->_squares_to_cards[square->id];
+			for (auto target_card = this->_cards.begin(); target_card != this->_cards.end(); target_card++)
+			{
+				int target_side = get_side(*target_card, get_opposite(direction));
 
-	const Square * target = square->get_neighbor(direction);
-	const Card * target_card = NULL;
+				if (side == target_side)
+					this->_same_masks[(*card)->id][direction] |= 1 << (*target_card)->id;
 
-	if (target)
-		target_card = this->_squares_to_cards[target->id];
+				this->_plus_sums[(*card)->id][direction][(*target_card)->id] = side + target_side;
+			}
 
-	if (!target_card)
-		return 0;
+			for (auto square = this->_squares.begin(); square != this->_squares.end(); square++)
+			{
+				const Square * target = (*square)->get_neighbor(direction);
+				unsigned short mask = 0;
 
-	switch(direction)
-	{
-		case NORTH:
-			return card->top + target_card->bottom;
+				for (auto target_card = this->_cards.begin(); target != NULL && target_card != this->_cards.end(); target_card++)
+				{
+					int score = side - get_side(*target_card, get_opposite(direction));
 
-		case SOUTH:
-			return card->bottom + target_card->top;
+					if (this->_elemental)
+						score += get_element_bonus(*square, *card) - get_element_bonus(target, *target_card);
 
-		case EAST:
-			return card->right + target_card->left;
+					if (score > 0)
+						mask |= 1 << (*target_card)->id;
+				}
 
-		case WEST:
-			return card->left + target_card->right;
+				this->_beat_masks[(*card)->id][(*square)->id][direction] = mask;
+			}
+		}
 	}
-
-	return 0;
 }
 
-bool GameBoard::_check_same(const Square * square, Direction direction)
+void GameBoard::_build_symmetries()
 {
-	const Card * card = this->_squares_to_cards[square->id];
-
-	const Square * target = square->get_neighbor(direction);
-	const Card * target_card = NULL;
+	static const Direction directions[] = { NORTH, SOUTH, EAST, WEST };
 
-	if (target)
+	for (int i = 0; i < 8; i++)
 	{
-		target_card = this->_squares_to_cards[target->id];
+		Symmetry symmetry;
 
-		if (!target_card)
-			return false;
-	}
+		// The four rotations, each followed by its mirror image.
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 3; col++)
+			{
+				int image_row = row, image_col = col;
 
-	int value;
-	int target_value;
+				for (int turn = 0; turn < i / 2; turn++)
+				{
+					int next_row = image_col;
+					image_col = 2 - image_row;
+					image_row = next_row;
+				}
 
-	if (!target_card && !this->_same_wall)
-		return false;
+				if (i % 2)
+					image_col = 2 - image_col;
 
-	switch (direction)
-	{
-		case NORTH:
-			value = card->top;
-			target_value = target_card ? target_card->bottom : 10;
-			break;
+				symmetry.squares[row * 3 + col] = image_row * 3 + image_col;
+				symmetry.inverse[image_row * 3 + image_col] = row * 3 + col;
+			}
+		}
 
-		case SOUTH:
-			value = card->bottom;
-			target_value = target_card ? target_card->top : 10;
-			break;
+		bool valid = true;
 
-		case EAST:
-			value = card->right;
-			target_value = target_card ? target_card->left : 10;
-			break;
+		for (int square = 0; square < 9 && valid; square++)
+			valid = !this->_elemental || this->_squares[square]->element == this->_squares[symmetry.squares[square]]->element;
 
-		case WEST:
-			value = card->left;
-			target_value = target_card ? target_card->right : 10;
-			break;
-	}
+		// Cards keep facing the same way, so every card has to show the same
+		// side in each direction as in the direction the symmetry turns it to.
+		// The center square stays put, so its neighbors tell how directions turn.
+		for (int j = 0; j < 4 && valid; j++)
+		{
+			int image = symmetry.squares[this->_neighbors[4][directions[j]]];
+			Direction direction = directions[j];
 
-	return value == target_value;
+			for (int k = 0; k < 4; k++)
+			{
+				if (this->_neighbors[4][directions[k]] == image)
+					direction = directions[k];
+			}
+
+			for (auto card = this->_cards.begin(); card != this->_cards.end() && valid; card++)
+				valid = get_side(*card, directions[j]) == get_side(*card, direction);
+		}
+
+		if (valid)
+			this->_symmetries.push_back(symmetry);
+	}
 }
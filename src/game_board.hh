@@ -23,19 +23,37 @@
 #ifndef TRIPLETRIAD_GAME_BOARD_HH
 #define TRIPLETRIAD_GAME_BOARD_HH
 
-#include <list>
 #include <memory>
-#include <stack>
 #include <vector>
 
 #include "SDL.h"
 
 #include "common.hh"
+#include "move_list.hh"
 
 class Card;
 class Move;
 class Square;
 
+// Everything about a game that changes from move to move. It is small and
+// trivially copyable, so the search can play a move by making a copy instead
+// of undoing it afterwards. Squares and cards are indexed by id. A set bit in
+// owners marks a card owned by blue.
+struct Position
+{
+	unsigned long long key;
+
+	unsigned short occupied;
+	unsigned short owners;
+	unsigned short played;
+	unsigned char squares_to_cards[9];
+
+	// Blue's score minus red's, kept up to date as cards flip.
+	int difference;
+
+	Piece current_piece;
+};
+
 class GameBoard
 {
 	public:
@@ -43,26 +61,104 @@ class GameBoard
 		GameBoard(const GameBoard & board);
 
 		void move(const Move * move);
-		void unmove();
+
+		const Position & get_position() const;
+
+		// The position a move leads to. The move must be valid there.
+		Position apply(const Position & position, const Move * move) const;
 
 		Piece get_current_piece();
 
 		int get_score(Piece piece);
 
+		// The piece's score minus its opponent's.
+		int get_score_difference(Piece piece);
+		int get_score_difference(const Position & position, Piece piece) const;
+
+		// The same, once the move has been made from the position. This is
+		// cheaper than applying the move whenever it sets off no combo.
+		int get_score_difference(const Position & position, const Move * move, Piece piece) const;
+
+		// Bounds on the score difference in favor of the piece that any sequence
+		// of moves from here can reach.
+		void get_score_bounds(Piece piece, int & lower, int & upper);
+		void get_score_bounds(const Position & position, Piece piece, int & lower, int & upper) const;
+
+		int get_empty_square_count();
+		int get_empty_square_count(const Position & position) const;
+
+		unsigned long long get_key();
+
+		// The smallest key among the position and its images under the
+		// symmetries of the board, along with the symmetry that gives it. Only
+		// symmetries that leave every square's element and every card's sides as
+		// they are count, so mirrored positions play out the same.
+		unsigned long long get_canonical_key(const Position & position, int & symmetry) const;
+
+		// The position as the symmetry from get_canonical_key() maps it, spelled
+		// out in full instead of hashed. Positions share a code only if they
+		// play out the same, so unlike keys, codes never collide.
+		unsigned long long get_canonical_code(const Position & position) const;
+		// The same, given the symmetry that get_canonical_key() has already
+		// picked.
+		unsigned long long get_canonical_code(const Position & position, int symmetry) const;
+
+		// A position with the given code. Of any twins, the ones with the lowest
+		// ids are taken to be on the board.
+		Position get_position(unsigned long long code) const;
+
+		// A move carried over by a symmetry, and carried back.
+		const Move * get_canonical_move(const Move * move, int symmetry) const;
+		const Move * get_original_move(const Move * move, int symmetry) const;
+
 		bool is_valid_move(const Move * move);
 
-		std::list<const Move *> get_valid_moves();
+		MoveList get_valid_moves();
+		// Only one of any cards in the hand that play exactly alike is offered.
+		MoveList get_valid_moves(const Position & position) const;
+
+		// The valid moves, less any that a symmetry leaving the position as it
+		// is turns into an earlier one.
+		MoveList get_distinct_moves(const Position & position) const;
+
+		// The number of cards the move would flip by the basic rule alone.
+		int get_flip_count(const Move * move);
+		int get_flip_count(const Position & position, const Move * move) const;
 
 		const Move * get_move(const Card * card, int row, int col);
 
+		// Moves are numbered by card and square, from 0 to 89, whatever order
+		// they were created in. That number is what gets stored or indexed.
+		const Move * get_move(int index) const;
+		int get_move_index(const Move * move) const;
+
 		void render(SDL_Surface * surface);
 	private:
-		void _execute_basic(const Square * square, bool check);
-		bool _execute_flip(const Square * square, Direction direction);
-		int _check_plus(const Square * square, Direction direction);
-		bool _check_same(const Square * square, Direction direction);
+		typedef void (GameBoard::*MoveFunction)(Position & position, const Move * move) const;
+
+		template <bool SAME, bool PLUS, bool SAME_WALL>
+		void _apply(Position & position, const Move * move) const;
+
+		// The squares next to the square holding cards of the other piece that
+		// the card would beat from there.
+		unsigned int _get_captures(const Position & position, int card, int square) const;
+
+		// The directions (as bits) whose neighbors the card takes by plus or by
+		// same from the square.
+		unsigned int _check_plus(const Position & position, int card, int square) const;
+
+		template <bool SAME_WALL>
+		unsigned int _check_same(const Position & position, int card, int square) const;
+
+		void _build_rule_tables();
+		void _build_symmetries();
+
+		const Card * _get_card(const Position & position, int square) const;
+		Piece _get_owner(const Position & position, int card) const;
+		unsigned int _get_cards(const Position & position, Piece piece) const;
+
+		void _flip(Position & position, int square) const;
 
-		Piece _current_piece;
 		bool _same, _plus, _same_wall, _elemental;
 
 		std::vector<const Card *> _cards;
@@ -70,12 +166,50 @@ class GameBoard
 
 		std::vector<const Move *> _moves;
 
-		std::vector<const Card *> _squares_to_cards;
-		std::vector<Piece> _owners;
-		std::vector<bool> _played_cards;
-
-		std::stack<const Move *> _move_history;
-		std::stack<const Card *> _card_history;
+		Position _position;
+
+		// The cards never change during a game, so how any two of them meet is
+		// worked out once, indexed by card id. A beat mask holds the cards that a
+		// card on a square beats in a direction, counting elements. A same mask
+		// holds the cards whose facing side equals the card's, with bit ten set
+		// for a side of A (matching the wall). Plus sums add the facing sides.
+		// Neighbors are square ids, or the square itself at the edge of the
+		// board. Walls hold the directions in which a square is at the edge.
+		unsigned char _neighbors[9][4];
+		unsigned char _walls[9];
+		unsigned short _beat_masks[10][9][4];
+		unsigned short _same_masks[10][4];
+		unsigned char _plus_sums[10][4][10];
+
+		// Cards dealt to the same player with the same sides (and element, if it
+		// counts) are interchangeable. A card's class is the lowest id among
+		// them, and its twins are the ones with lower ids than its own.
+		unsigned short _dealt_owners;
+		unsigned char _classes[10];
+		unsigned short _twins[10];
+
+		// Where each symmetry of the board that suits the game sends every
+		// square, and where its inverse does. The identity always comes first.
+		struct Symmetry
+		{
+			unsigned char squares[9];
+			unsigned char inverse[9];
+		};
+
+		std::vector<Symmetry> _symmetries;
+
+		// The moves made so far, so that the last one can be highlighted.
+		const Move * _history[9];
+		int _history_size;
+
+		// Placements are keyed by card class and square, so positions that only
+		// differ by which of two twins went where hash alike. For the same
+		// reason, a flip is keyed by the square of the card that changed hands.
+		std::vector<unsigned long long> _placement_keys;
+		std::vector<unsigned long long> _owner_keys;
+		std::vector<unsigned long long> _piece_keys;
+
+		MoveFunction _move_function;
 };
 
 #endif
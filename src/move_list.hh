@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2010 Jason Lynch <jason@calindora.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TRIPLETRIAD_MOVE_LIST_HH
+#define TRIPLETRIAD_MOVE_LIST_HH
+
+#include <cstddef>
+
+class Move;
+
+// A fixed-capacity list of moves that lives on the stack, so generating moves
+// never touches the heap. A position has at most five cards in hand and nine
+// empty squares.
+class MoveList
+{
+	public:
+		static const size_t CAPACITY = 5 * 9;
+
+		MoveList();
+
+		void push_back(const Move * move);
+
+		const Move ** begin();
+		const Move ** end();
+		const Move * const * begin() const;
+		const Move * const * end() const;
+
+		const Move * front() const;
+		const Move * operator[](size_t index) const;
+
+		size_t size() const;
+		bool empty() const;
+
+	private:
+		const Move * _moves[CAPACITY];
+		size_t _size;
+};
+
+inline MoveList::MoveList() :
+	_size(0)
+{ }
+
+inline void MoveList::push_back(const Move * move)
+{
+	this->_moves[this->_size++] = move;
+}
+
+inline const Move ** MoveList::begin()
+{
+	return this->_moves;
+}
+
+inline const Move ** MoveList::end()
+{
+	return this->_moves + this->_size;
+}
+
+inline const Move * const * MoveList::begin() const
+{
+	return this->_moves;
+}
+
+inline const Move * const * MoveList::end() const
+{
+	return this->_moves + this->_size;
+}
+
+inline const Move * MoveList::front() const
+{
+	return this->_moves[0];
+}
+
+inline const Move * MoveList::operator[](size_t index) const
+{
+	return this->_moves[index];
+}
+
+inline size_t MoveList::size() const
+{
+	return this->_size;
+}
+
+inline bool MoveList::empty() const
+{
+	return this->_size == 0;
+}
+
+#endif
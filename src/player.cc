@@ -20,115 +20,996 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iomanip>
 #include <iostream>
 #include <limits>
-#include <list>
 #include <set>
+#include <thread>
 
 #include "common.hh"
 #include "game_board.hh"
 #include "move.hh"
 #include "player.hh"
+#include "solver_context.hh"
+#include "tablebase.hh"
+#include "transposition_table.hh"
 #include "tripletriad.hh"
 
-Player::Player(std::shared_ptr<GameBoard> board, Piece my_piece, Piece opponent_piece) :
+// Root results are packed with the score in the high half and the inverted
+// move index in the low half, so the larger packed value is the higher score
+// or, for equal scores, the move that comes first.
+static unsigned long long pack_root_result(int score, int index)
+{
+	unsigned long long high = static_cast<unsigned int>(score) ^ 0x80000000u;
+	unsigned long long low = 0xFFFFFFFFu - static_cast<unsigned int>(index);
+
+	return (high << 32) | low;
+}
+
+static int root_result_score(unsigned long long result)
+{
+	return static_cast<int>(static_cast<unsigned int>(result >> 32) ^ 0x80000000u);
+}
+
+static int root_result_index(unsigned long long result)
+{
+	return static_cast<int>(0xFFFFFFFFu - static_cast<unsigned int>(result & 0xFFFFFFFFu));
+}
+
+// The same entry from the other player's point of view. Missing bounds stay
+// missing.
+static TranspositionTable::Entry get_opposite_entry(const TranspositionTable::Entry & entry)
+{
+	TranspositionTable::Entry opposite = entry;
+
+	opposite.lowerBound = entry.upperBound == std::numeric_limits<int>::max() ? std::numeric_limits<int>::min() : -entry.upperBound;
+	opposite.upperBound = entry.lowerBound == std::numeric_limits<int>::min() ? std::numeric_limits<int>::max() : -entry.lowerBound;
+
+	return opposite;
+}
+
+SearchOptions::SearchOptions() :
+	hash_megabytes(32),
+	threads(1),
+	split_depth(4),
+	driver(DRIVER_ALPHA_BETA),
+	time_limit(0),
+	wdl(false),
+	tablebase_squares(0)
+{ }
+
+Player::Worker::Worker(bool main) :
+	search(NULL),
+	split_point(NULL),
+	positions(0),
+	pruned(0),
+	next_poll(0),
+	complete(true),
+	main(main)
+{
+	std::fill(&this->killers[0][0], &this->killers[0][0] + 10 * 2, static_cast<const Move *>(NULL));
+	std::fill(this->history, this->history + 9 * 10, 0);
+}
+
+Player::SplitPoint::SplitPoint(SplitPoint * parent, const Position & position, int max_ply, int alpha, int beta, bool maximizing) :
+	parent(parent),
+	position(position),
+	max_ply(max_ply),
+	maximizing(maximizing),
+	moves(),
+	next(0),
+	alpha(alpha),
+	beta(beta),
+	best_move(NULL),
+	complete(true),
+	helpers(0),
+	cutoff(false)
+{ }
+
+Player::SharedSearch::SharedSearch(const Position & position, const MoveList & moves, int ply, int alpha, int beta, int threads) :
+	position(position),
+	moves(moves),
+	ply(ply),
+	beta(beta),
+	next(0),
+	best(pack_root_result(alpha, moves.size())),
+	split_points(),
+	searching(threads),
+	idle(0)
+{ }
+
+Player::Player(std::shared_ptr<GameBoard> board, std::shared_ptr<SolverContext> context, Piece my_piece, Piece opponent_piece, const SearchOptions & options) :
 	_board(board),
-	_test_board(std::shared_ptr<GameBoard>()),
+	_context(context),
+	_threads(options.threads),
+	_split_depth(options.split_depth),
+	_driver(options.driver),
+	_time_limit(options.time_limit),
+	_wdl(options.wdl),
+	_tablebase_squares(options.tablebase_squares),
+	_tablebase_megabytes(options.hash_megabytes),
+	_deadline(),
+	_stopped(false),
+	_score(0),
 	_my_piece(my_piece),
-	_opponent_piece(opponent_piece)
+	_opponent_piece(opponent_piece),
+	_ponder_thread()
 { }
 
+Player::~Player()
+{
+	this->stop_pondering();
+}
+
 const Move * Player::get_move()
 {
-	this->_test_board = this->_board;
+	this->stop_pondering();
+
+	const Move * solved_move;
+
+	if (this->_get_solved_move(solved_move))
+		return solved_move;
+
+	const Position & position = this->_board->get_position();
+
+	// The move's time counts from here, so a tablebase build comes out of it.
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (this->_tablebase_squares > 0 && this->_context->get_tablebase().get_squares() == 0)
+		this->_build_tablebase(position, start);
+
+	this->_context->get_table().newSearch();
+
+	std::vector<Worker> workers;
+	this->_create_workers(workers, true);
 
 	const Move * best_move = NULL;
+	int best_score = 0;
 
+	this->_stopped = false;
+
+	// Without a time limit, there is no use for the shallower searches, so the
+	// first search goes all the way to the end of the game.
+	int first_ply = this->_time_limit > 0 ? 1 : this->_board->get_empty_square_count(position);
 	bool complete = false;
 
-	for (int ply = 1; !complete; ply++)
+	for (int ply = first_ply; !complete; ply++)
 	{
-		int positions = 0;
-		int best_score = std::numeric_limits<int>::min();
-
-		std::list<const Move *> moves  = this->_test_board->get_valid_moves();
+		// The first iteration always finishes, so there is a move to play.
+		if (best_move)
+			this->_deadline = start + std::chrono::milliseconds(this->_time_limit);
+		else
+			this->_deadline = std::chrono::steady_clock::time_point::max();
 
-		for (auto iter = moves.begin(); iter != moves.end(); iter++)
+		for (auto worker = workers.begin(); worker != workers.end(); worker++)
 		{
-			this->_test_board->move(*iter);
+			worker->positions = 0;
+			worker->pruned = 0;
+			worker->next_poll = 0;
+			worker->complete = true;
+		}
 
-			complete = true;
-			int score = this->_search_minimax(ply - 1, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), complete, positions);
+		int score;
+		const Move * move;
 
-			this->_test_board->unmove();
+		this->_search_iteration(workers, position, ply, best_score, score, move);
 
-			if (score > best_score)
-			{
-				best_score = score;
-				best_move = *iter;
-			}
+		int positions = 0;
+		int pruned = 0;
+		complete = true;
 
-			positions++;
+		for (auto worker = workers.begin(); worker != workers.end(); worker++)
+		{
+			positions += worker->positions;
+			pruned += worker->pruned;
+			complete = complete && worker->complete;
 		}
 
 		std::cout << std::left;
 		std::cout << std::setw(12) << "Search Ply:" << std::setw(4) << ply;
 		std::cout << std::setw(11) << "Positions:" << std::setw(12) << positions;
+		std::cout << std::setw(8) << "Pruned:" << std::setw(10) << pruned;
+
+		if (this->_stopped)
+		{
+			std::cout << "Stopped" << std::endl;
+			break;
+		}
+
+		best_move = move;
+		best_score = score;
+
 		std::cout << std::setw(6) << "Move:" << std::setw(30) << (*best_move);
 		std::cout << std::setw(10) << "Utility:" << std::setw(10) << best_score;
 		std::cout << std::endl;
+
+		if (!complete && std::chrono::steady_clock::now() >= start + std::chrono::milliseconds(this->_time_limit))
+			break;
 	}
 
+	this->_score = best_score;
+
+	std::copy(workers[0].history, workers[0].history + 9 * 10, this->_context->get_history());
+
+	// The root itself is never stored by the search, so a finished solve is
+	// recorded here for whoever reaches this position next.
+	if (complete && !this->_stopped)
+		this->_store_solution(position, best_move, best_score);
+
 	return best_move;
 }
 
-int Player::_search_minimax(int max_ply, int alpha, int beta, bool & complete, int & positions)
+Outcome Player::get_outcome() const
+{
+	if (this->_score > 0)
+		return OUTCOME_WIN;
+	else if (this->_score < 0)
+		return OUTCOME_LOSS;
+
+	return OUTCOME_DRAW;
+}
+
+void Player::start_pondering()
 {
-	if (positions % 1000 == 0)
+	this->stop_pondering();
+
+	if (this->_board->get_valid_moves().empty())
+		return;
+
+	this->_stopped = false;
+	this->_ponder_thread = std::thread(&Player::_ponder, this, this->_board->get_position());
+}
+
+void Player::stop_pondering()
+{
+	if (!this->_ponder_thread.joinable())
+		return;
+
+	this->_stopped = true;
+	this->_ponder_thread.join();
+}
+
+void Player::_create_workers(std::vector<Worker> & workers, bool main)
+{
+	workers.push_back(Worker(main));
+
+	for (int i = 1; i < this->_threads; i++)
+		workers.push_back(Worker(false));
+
+	for (auto worker = workers.begin(); worker != workers.end(); worker++)
+		std::copy(this->_context->get_history(), this->_context->get_history() + 9 * 10, worker->history);
+}
+
+void Player::_build_tablebase(const Position & position, std::chrono::steady_clock::time_point start)
+{
+	Tablebase & tablebase = this->_context->get_tablebase();
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+	// Under a time limit, the build may take half of the move's time, which
+	// leaves the other half for the search.
+	if (this->_time_limit > 0)
+		deadline = start + std::chrono::milliseconds(this->_time_limit / 2);
+
+	Tablebase::BuildResult result = tablebase.build(*this->_board, position, this->_tablebase_squares, this->_tablebase_megabytes, deadline);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::cout << std::left;
+	std::cout << std::setw(12) << "Tablebase:" << std::setw(4) << this->_tablebase_squares;
+
+	if (result == Tablebase::BUILD_DONE)
+	{
+		std::cout << std::setw(11) << "Positions:" << std::setw(12) << tablebase.get_size();
+		std::cout << std::setw(13) << "Memory (KB):" << std::setw(10) << (tablebase.get_memory() / 1024);
+	}
+	else if (result == Tablebase::BUILD_TOO_LARGE)
+	{
+		std::cout << std::setw(46) << "Failed (too large)";
+	}
+	else
+	{
+		std::cout << std::setw(46) << "Failed (out of time)";
+	}
+
+	std::cout << std::setw(6) << "Time:" << elapsed.count() << "s" << std::endl;
+}
+
+bool Player::_get_solved_move(const Move * & move)
+{
+	int score;
+
+	if (!this->_find_solution(this->_board->get_position(), move, score) || !this->_board->is_valid_move(move))
+		return false;
+
+	this->_score = score;
+
+	std::cout << std::left;
+	std::cout << std::setw(12) << "Solved:" << std::setw(4) << "";
+	std::cout << std::setw(6) << "Move:" << std::setw(30) << (*move);
+	std::cout << std::setw(10) << "Utility:" << std::setw(10) << this->_score;
+	std::cout << std::endl;
+
+	return true;
+}
+
+bool Player::_find_solution(const Position & position, const Move * & move, int & score)
+{
+	int symmetry;
+	unsigned long long key = this->_board->get_canonical_key(position, symmetry);
+
+	TranspositionTable::Entry entry;
+
+	if (!this->_get_entry(key, entry) || entry.ply < this->_board->get_empty_square_count(position) || entry.bestMove == TranspositionTable::NO_MOVE)
+		return false;
+
+	// An exact score from a search to the end of the game settles the move.
+	// When only the outcome matters, so does a proven win, or a proven loss,
+	// for which the search would settle for any move as well.
+	if (entry.lowerBound != entry.upperBound && !(this->_wdl && (entry.lowerBound > 0 || entry.upperBound < 0)))
+		return false;
+
+	move = this->_board->get_original_move(this->_board->get_move(entry.bestMove), symmetry);
+	score = entry.upperBound < 0 ? entry.upperBound : entry.lowerBound;
+
+	return true;
+}
+
+void Player::_store_solution(const Position & position, const Move * move, int score)
+{
+	int symmetry;
+	unsigned long long key = this->_board->get_canonical_key(position, symmetry);
+
+	TranspositionTable::Entry entry;
+	entry.lowerBound = std::numeric_limits<int>::min();
+	entry.upperBound = std::numeric_limits<int>::max();
+	entry.ply = this->_board->get_empty_square_count(position);
+	entry.bestMove = this->_board->get_move_index(this->_board->get_canonical_move(move, symmetry));
+
+	// Only telling wins, draws and losses apart leaves anything but a draw
+	// a bound.
+	if (!this->_wdl || score >= 0)
+		entry.lowerBound = score;
+
+	if (!this->_wdl || score <= 0)
+		entry.upperBound = score;
+
+	this->_store_entry(key, entry);
+}
+
+void Player::_ponder(Position position)
+{
+	std::vector<Worker> workers;
+	this->_create_workers(workers, false);
+
+	// Replies that mirror each other lead to the same entry, and any reply the
+	// last search already solved, such as the one it expected, is skipped.
+	MoveList replies = this->_board->get_distinct_moves(position);
+
+	for (auto reply = replies.begin(); reply != replies.end(); reply++)
+	{
+		Position child = this->_board->apply(position, *reply);
+
+		const Move * move;
+		int score;
+
+		if (this->_board->get_valid_moves(child).empty() || this->_find_solution(child, move, score))
+			continue;
+
+		this->_search_iteration(workers, child, this->_board->get_empty_square_count(child), 0, score, move);
+
+		if (this->_stopped)
+			return;
+
+		this->_store_solution(child, move, score);
+	}
+}
+
+void Player::_search_iteration(std::vector<Worker> & workers, const Position & position, int ply, int guess, int & score, const Move * & move)
+{
+	// Every score is even, so a window of (-1, 1) around a draw is enough to
+	// tell a win (1) from a draw (0) from a loss (-1).
+	if (this->_wdl)
+		this->_search_window(workers, position, ply, -1, 1, score, move);
+	else if (this->_driver == DRIVER_MTDF)
+		this->_search_mtdf(workers, position, ply, guess, score, move);
+	else
+		this->_search_window(workers, position, ply, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), score, move);
+
+	// When every move loses, none of them beats the window and any one will
+	// do.
+	if (!move && !this->_stopped)
+		move = this->_board->get_valid_moves(position).front();
+}
+
+void Player::_search_window(std::vector<Worker> & workers, const Position & position, int ply, int alpha, int beta, int & score, const Move * & move)
+{
+	// Moves that mirror an earlier one lead to the same score, so they are left
+	// out. On the empty board, that can be all but one in eight.
+	MoveList moves = this->_board->get_distinct_moves(position);
+
+	SharedSearch search(position, moves, ply, alpha, beta, workers.size());
+
+	for (auto worker = workers.begin(); worker != workers.end(); worker++)
+		worker->search = &search;
+
+	std::vector<std::thread> threads;
+
+	for (size_t i = 1; i < workers.size(); i++)
+		threads.push_back(std::thread(&Player::_search_root, this, std::ref(workers[i]), std::ref(search)));
+
+	this->_search_root(workers[0], search);
+
+	for (auto thread = threads.begin(); thread != threads.end(); thread++)
+		thread->join();
+
+	// If no move beat alpha, the score is only an upper bound and there is no
+	// move to report.
+	int index = root_result_index(search.best);
+
+	score = root_result_score(search.best);
+	move = index < static_cast<int>(moves.size()) ? moves[index] : NULL;
+}
+
+void Player::_search_mtdf(std::vector<Worker> & workers, const Position & position, int ply, int guess, int & score, const Move * & move)
+{
+	int lower = std::numeric_limits<int>::min();
+	int upper = std::numeric_limits<int>::max();
+
+	move = NULL;
+	score = guess;
+
+	// Every null-window search either raises the lower bound or lowers the
+	// upper bound on the score, until the two meet. The move is the one that
+	// last proved a new lower bound. Both players hold ten cards between them,
+	// so the score is always even, and odd bounds can be rounded inwards.
+	while (lower < upper)
+	{
+		int beta = std::max(std::min(score, upper), lower + 1);
+		beta += beta & 1;
+
+		const Move * pass_move;
+
+		this->_search_window(workers, position, ply, beta - 1, beta, score, pass_move);
+
+		if (this->_stopped)
+			return;
+
+		if (score < beta)
+		{
+			upper = score - (score & 1);
+		}
+		else
+		{
+			lower = score + (score & 1);
+			move = pass_move;
+		}
+	}
+
+	// Scores from a search cut short at the ply limit can disagree between
+	// passes, in which case the bounds may cross without a move having been
+	// found. A full window search settles it.
+	if (move)
+		score = lower;
+	else
+		this->_search_window(workers, position, ply, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), score, move);
+}
+
+void Player::_search_root(Worker & worker, SharedSearch & search)
+{
+	int count = search.moves.size();
+
+	for (int index = search.next++; index < count; index = search.next++)
+	{
+		unsigned long long best = search.best;
+		int alpha = root_result_score(best);
+
+		// Only moves that beat the best score so far matter, so the earlier
+		// moves give every later subtree (and its table entries) a bound. A move
+		// that comes before the current best wins a tie, though, so it needs a
+		// window that can tell a tie from a loss.
+		if (index < root_result_index(best) && root_result_index(best) < count && alpha != std::numeric_limits<int>::min())
+			alpha--;
+
+		Position child = this->_board->apply(search.position, search.moves[index]);
+
+		bool complete = true;
+		int score = this->_search_minimax(worker, child, search.ply - 1, alpha, search.beta, complete);
+
+		if (this->_is_aborted(worker))
+			break;
+
+		worker.complete = worker.complete && complete;
+		worker.positions++;
+
+		if (score > alpha)
+		{
+			unsigned long long result = pack_root_result(score, index);
+
+			while (result > best && !search.best.compare_exchange_weak(best, result))
+				;
+		}
+
+		// A move reaching beta settles the search, so no more moves are handed out.
+		if (score >= search.beta)
+			search.next = count;
+	}
+
+	// Once the root moves run out, help the threads still searching theirs.
+	this->_wait_for_work(worker, search, NULL);
+}
+
+void Player::_search_split_point(Worker & worker, SplitPoint & split_point)
+{
+	while (true)
+	{
+		const Move * move;
+		int alpha, beta;
+
+		{
+			std::lock_guard<std::mutex> lock(split_point.mutex);
+
+			if (split_point.cutoff || split_point.next >= split_point.moves.size())
+				break;
+
+			move = split_point.moves[split_point.next++];
+			alpha = split_point.alpha;
+			beta = split_point.beta;
+		}
+
+		Position child = this->_board->apply(split_point.position, move);
+
+		bool complete = true;
+		int score = this->_search_minimax(worker, child, split_point.max_ply - 1, alpha, beta, complete);
+
+		if (this->_is_aborted(worker))
+			break;
+
+		worker.positions++;
+
+		std::lock_guard<std::mutex> lock(split_point.mutex);
+
+		split_point.complete = split_point.complete && complete;
+
+		if (split_point.maximizing)
+		{
+			if (score >= split_point.beta)
+			{
+				this->_record_cutoff(worker, move, 9 - this->_board->get_empty_square_count(split_point.position), split_point.max_ply);
+				split_point.best_move = move;
+				split_point.cutoff = true;
+			}
+			else if (score > split_point.alpha)
+			{
+				split_point.best_move = move;
+				split_point.alpha = score;
+			}
+		}
+		else
+		{
+			if (score <= split_point.alpha)
+			{
+				this->_record_cutoff(worker, move, 9 - this->_board->get_empty_square_count(split_point.position), split_point.max_ply);
+				split_point.best_move = move;
+				split_point.cutoff = true;
+			}
+			else if (score < split_point.beta)
+			{
+				split_point.best_move = move;
+				split_point.beta = score;
+			}
+		}
+	}
+}
+
+int Player::_search_minimax(Worker & worker, const Position & position, int max_ply, int alpha, int beta, bool & complete)
+{
+	if (worker.main && worker.positions >= worker.next_poll)
+	{
+		worker.next_poll = worker.positions + 1000;
+
 		TripleTriad::get_instance("")->checkEvent(false);
 
-	std::list<const Move *> moves = this->_test_board->get_valid_moves();
+		if (std::chrono::steady_clock::now() >= this->_deadline)
+			this->_stopped = true;
+	}
+
+	if (this->_is_aborted(worker))
+		return 0;
+
+	int empty_squares = this->_board->get_empty_square_count(position);
+	const Tablebase & tablebase = this->_context->get_tablebase();
+
+	// Mirror images of a position share its table entries, found through the
+	// image with the smallest key. The key is only worked out where something
+	// is looked up.
+	int symmetry = 0;
+	unsigned long long key = 0;
+	bool canonical = false;
+
+	// Near the end of the game, the score may have been worked out before the
+	// search, however deep this search would have gone.
+	if (empty_squares > 0 && empty_squares <= tablebase.get_squares())
+	{
+		int score;
+
+		key = this->_board->get_canonical_key(position, symmetry);
+		canonical = true;
+
+		if (tablebase.get_score(empty_squares, this->_board->get_canonical_code(position, symmetry), score))
+		{
+			if (this->_my_piece != PIECE_BLUE)
+				score = -score;
+
+			return std::max(alpha, std::min(beta, score));
+		}
+	}
+
+	MoveList moves = this->_board->get_valid_moves(position);
 
 	if (max_ply == 0 && !moves.empty())
 		complete = false;
 
 	if (max_ply == 0 || moves.empty())
-		return this->_evaluate();
+		return this->_evaluate(position);
+
+	// No line from here can leave the window if the cards still in play cannot
+	// flip enough of each other.
+	int lower, upper;
+	this->_board->get_score_bounds(position, this->_my_piece, lower, upper);
+
+	if (upper <= alpha || lower >= beta)
+	{
+		worker.pruned++;
+		return upper <= alpha ? alpha : beta;
+	}
+
+	// Entries are only trusted if they were searched at least as deep as this
+	// node will be. A depth that stops short of the end of the game means the
+	// stored bounds came from an incomplete search.
+	int depth = std::min(max_ply, empty_squares);
+
+	// When every child is a leaf, each one is scored straight from the move
+	// instead of being built and searched. That is cheap enough that neither
+	// ordering the moves nor probing the table pays off there.
+	bool leaves = depth == 1;
+
+	if (leaves && depth < empty_squares)
+		complete = false;
+
+	// The best move is stored as it would be played in the image with the
+	// smallest key.
+	TranspositionTable::Entry entry;
+	bool found = false;
+
+	if (!leaves)
+	{
+		if (!canonical)
+			key = this->_board->get_canonical_key(position, symmetry);
+
+		found = this->_get_entry(key, entry);
+	}
+
+	if (found && entry.ply >= depth)
+	{
+		if (depth < empty_squares)
+			complete = false;
+
+		if (entry.lowerBound >= beta)
+			return beta;
+
+		if (entry.upperBound <= alpha)
+			return alpha;
+
+		if (entry.lowerBound == entry.upperBound)
+			return entry.lowerBound;
+
+		alpha = std::max(alpha, entry.lowerBound);
+		beta = std::min(beta, entry.upperBound);
+	}
+
+	const Move * hash_move = NULL;
+
+	if (found && entry.bestMove != TranspositionTable::NO_MOVE)
+		hash_move = this->_board->get_original_move(this->_board->get_move(entry.bestMove), symmetry);
+
+	if (!leaves)
+		this->_order_moves(worker, position, moves, hash_move);
+
+	bool maximizing = position.current_piece == this->_my_piece;
+	const Move * best_move = NULL;
+
+	int original_alpha = alpha;
+	int original_beta = beta;
+	int result = maximizing ? alpha : beta;
 
 	for (auto iter = moves.begin(); iter != moves.end(); iter++)
 	{
-		this->_test_board->move(*iter);
-		int score = this->_search_minimax(max_ply - 1, alpha, beta, complete, positions);
-		this->_test_board->unmove();
+		// Once the first move has been searched, the rest can be shared with any
+		// idle threads (the young brothers wait for the eldest).
+		if (iter != moves.begin() && this->_split_depth > 0 && depth >= this->_split_depth && worker.search->idle > 0)
+		{
+			SplitPoint split_point(worker.split_point, position, max_ply, alpha, beta, maximizing);
+			for (auto move = iter; move != moves.end(); move++)
+				split_point.moves.push_back(*move);
+			split_point.best_move = best_move;
+
+			this->_split(worker, split_point);
+
+			if (this->_is_aborted(worker))
+				return 0;
 
-		if (this->_test_board->get_current_piece() == this->_my_piece)
+			complete = complete && split_point.complete;
+			best_move = split_point.best_move;
+			alpha = split_point.alpha;
+			beta = split_point.beta;
+
+			if (split_point.cutoff)
+				result = maximizing ? beta : alpha;
+			else
+				result = maximizing ? alpha : beta;
+
+			break;
+		}
+
+		int score;
+
+		if (leaves)
+		{
+			score = this->_board->get_score_difference(position, *iter, this->_my_piece);
+		}
+		else
+		{
+			Position child = this->_board->apply(position, *iter);
+			score = this->_search_minimax(worker, child, max_ply - 1, alpha, beta, complete);
+
+			if (this->_is_aborted(worker))
+				return 0;
+		}
+
+		if (maximizing)
 		{
 			if (score >= beta)
-				return beta;
+			{
+				this->_record_cutoff(worker, *iter, 9 - empty_squares, depth);
+				best_move = *iter;
+				result = beta;
+				break;
+			}
 
 			if (score > alpha)
+			{
+				best_move = *iter;
 				alpha = score;
+			}
+
+			result = alpha;
 		}
 		else
 		{
 			if (score <= alpha)
-				return alpha;
+			{
+				this->_record_cutoff(worker, *iter, 9 - empty_squares, depth);
+				best_move = *iter;
+				result = alpha;
+				break;
+			}
 
 			if (score < beta)
+			{
+				best_move = *iter;
 				beta = score;
+			}
+
+			result = beta;
 		}
 
-		positions++;
+		worker.positions++;
+	}
+
+	if (leaves)
+		return result;
+
+	// The recursion may have replaced the entry, so it has to be looked up
+	// again before it is updated.
+	if (!this->_get_entry(key, entry) || entry.ply != depth)
+	{
+		entry.lowerBound = std::numeric_limits<int>::min();
+		entry.upperBound = std::numeric_limits<int>::max();
+		entry.bestMove = TranspositionTable::NO_MOVE;
 	}
 
-	if (this->_test_board->get_current_piece() == this->_my_piece)
-		return alpha;
+	if (result <= original_alpha)
+		entry.upperBound = result;
+	else if (result >= original_beta)
+		entry.lowerBound = result;
 	else
-		return beta;
+		entry.lowerBound = entry.upperBound = result;
+
+	entry.ply = depth;
+
+	if (best_move)
+		entry.bestMove = this->_board->get_move_index(this->_board->get_canonical_move(best_move, symmetry));
+
+	this->_store_entry(key, entry);
+
+	return result;
+}
+
+void Player::_order_moves(Worker & worker, const Position & position, MoveList & moves, const Move * hash_move)
+{
+	// History counts only break ties between moves that flip the same number
+	// of cards, so they are capped below the weight of a single flip.
+	static const int HISTORY_LIMIT = 1 << 20;
+
+	int ply = 9 - this->_board->get_empty_square_count(position);
+	int scores[MoveList::CAPACITY];
+
+	for (size_t i = 0; i < moves.size(); i++)
+	{
+		const Move * move = moves[i];
+
+		if (move == hash_move)
+			scores[i] = std::numeric_limits<int>::max();
+		else if (move == worker.killers[ply][0])
+			scores[i] = std::numeric_limits<int>::max() - 1;
+		else if (move == worker.killers[ply][1])
+			scores[i] = std::numeric_limits<int>::max() - 2;
+		else
+			scores[i] = this->_board->get_flip_count(position, move) * HISTORY_LIMIT + std::min(worker.history[this->_board->get_move_index(move)], HISTORY_LIMIT - 1);
+	}
+
+	// A stable insertion sort, best first. The lists are short, and unlike
+	// std::stable_sort it needs no temporary buffer.
+	const Move ** ordered = moves.begin();
+
+	for (size_t i = 1; i < moves.size(); i++)
+	{
+		int score = scores[i];
+		const Move * move = ordered[i];
+		size_t j = i;
+
+		for (; j > 0 && scores[j - 1] < score; j--)
+		{
+			scores[j] = scores[j - 1];
+			ordered[j] = ordered[j - 1];
+		}
+
+		scores[j] = score;
+		ordered[j] = move;
+	}
+}
+
+void Player::_record_cutoff(Worker & worker, const Move * move, int ply, int depth)
+{
+	if (worker.killers[ply][0] != move)
+	{
+		worker.killers[ply][1] = worker.killers[ply][0];
+		worker.killers[ply][0] = move;
+	}
+
+	worker.history[this->_board->get_move_index(move)] += depth * depth;
+}
+
+void Player::_split(Worker & worker, SplitPoint & split_point)
+{
+	SharedSearch & search = *worker.search;
+
+	{
+		std::lock_guard<std::mutex> lock(search.mutex);
+		search.split_points.push_back(&split_point);
+		search.condition.notify_all();
+	}
+
+	SplitPoint * parent = worker.split_point;
+	worker.split_point = &split_point;
+
+	this->_search_split_point(worker, split_point);
+
+	{
+		std::lock_guard<std::mutex> lock(search.mutex);
+		search.split_points.erase(std::find(search.split_points.begin(), search.split_points.end(), &split_point));
+	}
+
+	// While the helpers finish their moves, help with any work they have split
+	// off in turn.
+	this->_wait_for_work(worker, search, &split_point);
+
+	worker.split_point = parent;
+}
+
+void Player::_wait_for_work(Worker & worker, SharedSearch & search, SplitPoint * master)
+{
+	std::unique_lock<std::mutex> lock(search.mutex);
+
+	if (!master)
+	{
+		search.searching--;
+		search.condition.notify_all();
+	}
+
+	search.idle++;
+
+	while (master ? master->helpers > 0 : search.searching > 0)
+	{
+		SplitPoint * split_point = NULL;
+
+		for (auto iter = search.split_points.begin(); iter != search.split_points.end() && !split_point; iter++)
+		{
+			// A thread waiting on its own split point may only help below it, or
+			// it could end up waiting on a node it is itself searching.
+			bool below = !master;
+
+			for (SplitPoint * ancestor = (*iter)->parent; ancestor && !below; ancestor = ancestor->parent)
+				below = ancestor == master;
+
+			if (!below)
+				continue;
+
+			std::lock_guard<std::mutex> split_lock((*iter)->mutex);
+
+			if (!(*iter)->cutoff && (*iter)->next < (*iter)->moves.size())
+				split_point = *iter;
+		}
+
+		if (!split_point)
+		{
+			search.condition.wait(lock);
+			continue;
+		}
+
+		split_point->helpers++;
+		search.idle--;
+		lock.unlock();
+
+		SplitPoint * previous = worker.split_point;
+		worker.split_point = split_point;
+
+		this->_search_split_point(worker, *split_point);
+
+		worker.split_point = previous;
+
+		lock.lock();
+		split_point->helpers--;
+		search.idle++;
+		search.condition.notify_all();
+	}
+
+	search.idle--;
+}
+
+bool Player::_is_aborted(const Worker & worker)
+{
+	if (this->_stopped)
+		return true;
+
+	for (SplitPoint * split_point = worker.split_point; split_point; split_point = split_point->parent)
+	{
+		if (split_point->cutoff)
+			return true;
+	}
+
+	return false;
+}
+
+bool Player::_get_entry(unsigned long long key, TranspositionTable::Entry & entry)
+{
+	if (!this->_context->get_table().getEntry(key, entry))
+		return false;
+
+	if (this->_my_piece == PIECE_RED)
+		entry = get_opposite_entry(entry);
+
+	return true;
+}
+
+void Player::_store_entry(unsigned long long key, const TranspositionTable::Entry & entry)
+{
+	this->_context->get_table().storeEntry(key, this->_my_piece == PIECE_RED ? get_opposite_entry(entry) : entry);
 }
 
-int Player::_evaluate()
+int Player::_evaluate(const Position & position)
 {
-	return this->_test_board->get_score(this->_my_piece) - this->_test_board->get_score(this->_opponent_piece);
+	return this->_board->get_score_difference(position, this->_my_piece);
 }
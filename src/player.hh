@@ -23,30 +23,229 @@
 #ifndef TRIPLETRIAD_PLAYER_HH
 #define TRIPLETRIAD_PLAYER_HH
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-class GameBoard;
+#include "game_board.hh"
+#include "move_list.hh"
+#include "transposition_table.hh"
+
+class Move;
+class SolverContext;
+
+enum SearchDriver
+{
+	// Alpha-beta with the full window at the root.
+	DRIVER_ALPHA_BETA,
+
+	// A series of null-window searches converging on the score (MTD(f)).
+	DRIVER_MTDF
+};
+
+enum Outcome
+{
+	OUTCOME_LOSS = -1,
+	OUTCOME_DRAW,
+	OUTCOME_WIN
+};
+
+struct SearchOptions
+{
+	SearchOptions();
+
+	// Memory budget for the transposition table, in megabytes.
+	size_t hash_megabytes;
+
+	// Number of search threads.
+	int threads;
+
+	// Minimum remaining depth at which a node below the root may be shared
+	// between threads. Zero only shares the root moves.
+	int split_depth;
+
+	// How each iteration of the search looks for the root score.
+	SearchDriver driver;
+
+	// Time allowed for each move, in milliseconds. Zero solves every position
+	// to the end of the game in one search. Otherwise, the search deepens one
+	// ply at a time and plays the best move of the last finished iteration
+	// once the time is up.
+	int time_limit;
+
+	// Only tell wins, draws and losses apart instead of finding the exact
+	// score, which lets the search stop as soon as the outcome is proven.
+	bool wdl;
+
+	// Solve every position with this many empty squares or fewer before the
+	// first search, so that searches stop as soon as they reach one. The build
+	// may take as much memory again as the transposition table, and under a
+	// time limit, half of the move's time. If either runs out, it is tried
+	// again on the next move. Zero turns it off.
+	int tablebase_squares;
+};
 
 class Player
 {
 	public:
-		Player(std::shared_ptr<GameBoard> board, Piece my_piece, Piece opponent_piece);
+		Player(std::shared_ptr<GameBoard> board, std::shared_ptr<SolverContext> context, Piece my_piece, Piece opponent_piece, const SearchOptions & options);
 		~Player();
 
 		const Move * get_move();
 
+		// The outcome the last move was expected to lead to.
+		Outcome get_outcome() const;
+
+		// Solves, in the background while the opponent thinks, every position
+		// their reply can lead to, so that get_move() can answer whichever one
+		// they choose straight from the table. Only meant for when the opponent
+		// is a human, as nothing else may search meanwhile. get_move() stops it.
+		void start_pondering();
+		void stop_pondering();
+
 	private:
-		int _search_minimax(int max_ply, int alpha, int beta, bool & complete, int & positions);
+		struct SplitPoint;
+		struct SharedSearch;
+
+		// The state belonging to a single search thread. Threads share the board
+		// and only ever read from it, searching on copies of positions.
+		struct Worker
+		{
+			Worker(bool main);
+
+			SharedSearch * search;
+
+			// The innermost split point this worker is searching below, if any.
+			SplitPoint * split_point;
+
+			// Moves that recently caused a cutoff at each ply of the game, and how
+			// much each move has caused cutoffs anywhere, indexed by
+			// GameBoard::get_move_index().
+			const Move * killers[10][2];
+			int history[9 * 10];
+
+			int positions;
+			int pruned;
+
+			// The position count at which the main thread next checks for events
+			// and the deadline.
+			int next_poll;
+			bool complete;
 
-		int _evaluate();
+			// Only the main thread may handle SDL events.
+			bool main;
+		};
+
+		// A node whose remaining moves are shared out between threads. The thread
+		// that created it waits for every helper to leave before returning.
+		struct SplitPoint
+		{
+			SplitPoint(SplitPoint * parent, const Position & position, int max_ply, int alpha, int beta, bool maximizing);
+
+			SplitPoint * const parent;
+			const Position position;
+
+			const int max_ply;
+			const bool maximizing;
+
+			// The search state of the node, guarded by the mutex.
+			std::mutex mutex;
+			MoveList moves;
+			size_t next;
+			int alpha, beta;
+			const Move * best_move;
+			bool complete;
+
+			// The number of helpers, guarded by the mutex of the search.
+			int helpers;
+
+			// Set once the node is cut off, so that everyone below it can stop.
+			std::atomic<bool> cutoff;
+		};
+
+		// The state shared by all threads during one search iteration. The root
+		// moves are handed out one at a time. The best score and its move index
+		// are packed into a single word so that both can be read and updated
+		// atomically.
+		struct SharedSearch
+		{
+			SharedSearch(const Position & position, const MoveList & moves, int ply, int alpha, int beta, int threads);
+
+			const Position position;
+			const MoveList & moves;
+			const int ply;
+			const int beta;
+
+			std::atomic<int> next;
+			std::atomic<unsigned long long> best;
+
+			// Open split points and the number of threads still searching root
+			// moves, guarded by the mutex.
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::vector<SplitPoint *> split_points;
+			int searching;
+
+			std::atomic<int> idle;
+		};
+
+		void _create_workers(std::vector<Worker> & workers, bool main);
+		void _build_tablebase(const Position & position, std::chrono::steady_clock::time_point start);
+
+		bool _get_solved_move(const Move * & move);
+		bool _find_solution(const Position & position, const Move * & move, int & score);
+		void _store_solution(const Position & position, const Move * move, int score);
+
+		void _ponder(Position position);
+
+		void _search_iteration(std::vector<Worker> & workers, const Position & position, int ply, int guess, int & score, const Move * & move);
+		void _search_window(std::vector<Worker> & workers, const Position & position, int ply, int alpha, int beta, int & score, const Move * & move);
+		void _search_mtdf(std::vector<Worker> & workers, const Position & position, int ply, int guess, int & score, const Move * & move);
+
+		void _search_root(Worker & worker, SharedSearch & search);
+		void _search_split_point(Worker & worker, SplitPoint & split_point);
+		int _search_minimax(Worker & worker, const Position & position, int max_ply, int alpha, int beta, bool & complete);
+
+		void _order_moves(Worker & worker, const Position & position, MoveList & moves, const Move * hash_move);
+		void _record_cutoff(Worker & worker, const Move * move, int ply, int depth);
+
+		void _split(Worker & worker, SplitPoint & split_point);
+		void _wait_for_work(Worker & worker, SharedSearch & search, SplitPoint * master);
+		bool _is_aborted(const Worker & worker);
+
+		// Table entries are kept from blue's point of view, so red turns the
+		// bounds around as it reads and writes them.
+		bool _get_entry(unsigned long long key, TranspositionTable::Entry & entry);
+		void _store_entry(unsigned long long key, const TranspositionTable::Entry & entry);
+
+		int _evaluate(const Position & position);
 
 		std::shared_ptr<GameBoard> _board;
-		std::shared_ptr<GameBoard> _test_board;
+
+		std::shared_ptr<SolverContext> _context;
+
+		int _threads;
+		int _split_depth;
+		SearchDriver _driver;
+		int _time_limit;
+		bool _wdl;
+		int _tablebase_squares;
+		size_t _tablebase_megabytes;
+
+		std::chrono::steady_clock::time_point _deadline;
+		std::atomic<bool> _stopped;
+
+		int _score;
 
 		Piece _my_piece;
 		Piece _opponent_piece;
 
-
+		std::thread _ponder_thread;
 };
 
 #endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2010 Jason Lynch <jason@calindora.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TRIPLETRIAD_SOLVER_CONTEXT_HH
+#define TRIPLETRIAD_SOLVER_CONTEXT_HH
+
+#include <cstddef>
+
+#include "tablebase.hh"
+#include "transposition_table.hh"
+
+// The search state that outlives a single move. One context serves both
+// players for a whole game, so whatever one search learns is there for every
+// later one, whoever makes it.
+class SolverContext
+{
+	public:
+		SolverContext(size_t hash_megabytes);
+
+		// Scores in the table are from blue's point of view.
+		TranspositionTable & get_table();
+
+		// How much each move has caused cutoffs, indexed by
+		// GameBoard::get_move_index(). Every search starts from these counts
+		// and leaves its own behind.
+		int * get_history();
+
+		// Built by the first search that wants it, from the position it starts
+		// at, which every later position in the game is reached from.
+		Tablebase & get_tablebase();
+
+	private:
+		SolverContext(const SolverContext &);
+		SolverContext & operator=(const SolverContext &);
+
+		TranspositionTable _table;
+		int _history[9 * 10];
+
+		Tablebase _tablebase;
+};
+
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2010 Jason Lynch <jason@calindora.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+#include "common.hh"
+#include "game_board.hh"
+#include "move_list.hh"
+#include "tablebase.hh"
+#include "tripletriad.hh"
+
+// How many positions the build goes through between checks for events and the
+// deadline.
+static const int POLL_INTERVAL = 4096;
+
+Tablebase::Tablebase() :
+	_squares(0),
+	_codes(),
+	_scores()
+{ }
+
+Tablebase::BuildResult Tablebase::build(const GameBoard & board, const Position & position, int squares, size_t megabytes, std::chrono::steady_clock::time_point deadline)
+{
+	this->_clear();
+
+	int empty_squares = board.get_empty_square_count(position);
+	squares = std::min(squares, empty_squares);
+
+	if (squares < 1)
+		return BUILD_TOO_LARGE;
+
+	size_t budget = megabytes * 1024 * 1024;
+	int work = 0;
+
+	// Every position reachable from the given one, a layer of codes for each
+	// number of empty squares. Only the layers to be solved are kept, and they
+	// become the tablebase. The game ends on the last move, so positions with
+	// no empty squares are never stored.
+	this->_codes.resize(squares + 1);
+	this->_scores.resize(squares + 1);
+
+	std::vector<unsigned long long> layer(1, board.get_canonical_code(position));
+
+	for (int empty = empty_squares; empty > 1; empty--)
+	{
+		std::vector<unsigned long long> next;
+		size_t used = this->get_memory() + layer.capacity() * sizeof(unsigned long long);
+
+		for (auto code = layer.begin(); code != layer.end(); code++)
+		{
+			Position parent = board.get_position(*code);
+			MoveList moves = board.get_valid_moves(parent);
+
+			for (auto move = moves.begin(); move != moves.end(); move++)
+			{
+				if (++work % POLL_INTERVAL == 0 && Tablebase::_is_stopped(deadline))
+				{
+					this->_clear();
+					return BUILD_STOPPED;
+				}
+
+				// The same position is reached by many orders of moves, so once
+				// there is no more room, the duplicates are dropped. That has to
+				// free at least half of it, or the build would spend all its time
+				// sorting.
+				if (next.size() == next.capacity() && !Tablebase::_grow(next, used, budget))
+				{
+					Tablebase::_compact(next);
+
+					if (next.size() * 2 > next.capacity())
+					{
+						this->_clear();
+						return BUILD_TOO_LARGE;
+					}
+				}
+
+				next.push_back(board.get_canonical_code(board.apply(parent, *move)));
+			}
+		}
+
+		Tablebase::_compact(next);
+
+		// Trimming copies the codes, so it is only done when there is room for
+		// both copies.
+		if (used + (next.capacity() + next.size()) * sizeof(unsigned long long) <= budget)
+			next.shrink_to_fit();
+
+		if (empty <= squares)
+			this->_codes[empty].swap(layer);
+
+		layer.swap(next);
+	}
+
+	this->_codes[1].swap(layer);
+
+	// Each layer is solved from the one below it. Cards played on the last
+	// square are scored straight from the move.
+	for (int empty = 1; empty <= squares; empty++)
+	{
+		const std::vector<unsigned long long> & codes = this->_codes[empty];
+		std::vector<signed char> & scores = this->_scores[empty];
+
+		if (this->get_memory() + codes.size() * sizeof(signed char) > budget)
+		{
+			this->_clear();
+			return BUILD_TOO_LARGE;
+		}
+
+		scores.reserve(codes.size());
+
+		for (auto code = codes.begin(); code != codes.end(); code++)
+		{
+			if (++work % POLL_INTERVAL == 0 && Tablebase::_is_stopped(deadline))
+			{
+				this->_clear();
+				return BUILD_STOPPED;
+			}
+
+			Position node = board.get_position(*code);
+			MoveList moves = board.get_valid_moves(node);
+			bool maximizing = node.current_piece == PIECE_BLUE;
+			int best = maximizing ? std::numeric_limits<int>::min() : std::numeric_limits<int>::max();
+
+			// Every child was enumerated along with the layer below, so its score
+			// is always found there.
+			for (auto move = moves.begin(); move != moves.end(); move++)
+			{
+				int score = 0;
+
+				if (empty == 1)
+					score = board.get_score_difference(node, *move, PIECE_BLUE);
+				else
+					this->get_score(empty - 1, board.get_canonical_code(board.apply(node, *move)), score);
+
+				best = maximizing ? std::max(best, score) : std::min(best, score);
+			}
+
+			scores.push_back(best);
+		}
+	}
+
+	this->_squares = squares;
+
+	return BUILD_DONE;
+}
+
+int Tablebase::get_squares() const
+{
+	return this->_squares;
+}
+
+bool Tablebase::get_score(int empty_squares, unsigned long long code, int & score) const
+{
+	const std::vector<unsigned long long> & codes = this->_codes[empty_squares];
+	auto found = std::lower_bound(codes.begin(), codes.end(), code);
+
+	if (found == codes.end() || *found != code)
+		return false;
+
+	score = this->_scores[empty_squares][found - codes.begin()];
+
+	return true;
+}
+
+size_t Tablebase::get_size() const
+{
+	size_t size = 0;
+
+	for (auto codes = this->_codes.begin(); codes != this->_codes.end(); codes++)
+		size += codes->size();
+
+	return size;
+}
+
+size_t Tablebase::get_memory() const
+{
+	size_t memory = 0;
+
+	for (size_t i = 0; i < this->_codes.size(); i++)
+		memory += this->_codes[i].capacity() * sizeof(unsigned long long) + this->_scores[i].capacity() * sizeof(signed char);
+
+	return memory;
+}
+
+void Tablebase::_clear()
+{
+	this->_squares = 0;
+	std::vector<std::vector<unsigned long long> >().swap(this->_codes);
+	std::vector<std::vector<signed char> >().swap(this->_scores);
+}
+
+bool Tablebase::_grow(std::vector<unsigned long long> & codes, size_t used, size_t budget)
+{
+	// Growing copies the codes into a new block before the old one is freed,
+	// so both count against the budget.
+	size_t room = budget > used ? (budget - used) / sizeof(unsigned long long) : 0;
+	size_t capacity = codes.capacity();
+
+	if (room <= capacity)
+		return false;
+
+	size_t grown = std::min(std::max(2 * capacity, static_cast<size_t>(1024)), room - capacity);
+
+	if (grown <= codes.size())
+		return false;
+
+	codes.reserve(grown);
+
+	return true;
+}
+
+void Tablebase::_compact(std::vector<unsigned long long> & codes)
+{
+	std::sort(codes.begin(), codes.end());
+	codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+}
+
+bool Tablebase::_is_stopped(std::chrono::steady_clock::time_point deadline)
+{
+	TripleTriad::get_instance("")->checkEvent(false);
+
+	return std::chrono::steady_clock::now() >= deadline;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2010 Jason Lynch <jason@calindora.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TRIPLETRIAD_TABLEBASE_HH
+#define TRIPLETRIAD_TABLEBASE_HH
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "game_board.hh"
+
+// The scores of every position near the end of one game, worked out ahead of
+// the search. Positions are looked up by their canonical code in a sorted
+// array for each number of empty squares, so mirrored positions share a score
+// and no two positions are ever mistaken for each other.
+class Tablebase
+{
+	public:
+		enum BuildResult
+		{
+			BUILD_DONE,
+
+			// The positions that had to be held at once did not fit.
+			BUILD_TOO_LARGE,
+
+			// The deadline passed first.
+			BUILD_STOPPED
+		};
+
+		Tablebase();
+
+		// Solves every position with at most the given number of empty squares
+		// that can be reached from the position, from the last move of the game
+		// back. Everything the build holds, the finished tablebase included,
+		// stays within the given memory. Like the search, the build checks for
+		// events as it goes. A build that does not finish leaves the tablebase
+		// empty.
+		BuildResult build(const GameBoard & board, const Position & position, int squares, size_t megabytes, std::chrono::steady_clock::time_point deadline);
+
+		// The number of empty squares up to which positions are solved, or zero
+		// before a build.
+		int get_squares() const;
+
+		// Blue's score minus red's at the end of the game, with best play from
+		// the position with the given number of empty squares and canonical
+		// code (see GameBoard::get_canonical_code()).
+		bool get_score(int empty_squares, unsigned long long code, int & score) const;
+
+		size_t get_size() const;
+		size_t get_memory() const;
+
+	private:
+		void _clear();
+
+		// Makes room for more codes without the codes and the given bytes used
+		// elsewhere going over the budget.
+		static bool _grow(std::vector<unsigned long long> & codes, size_t used, size_t budget);
+
+		// Sorts the codes and drops any repeats.
+		static void _compact(std::vector<unsigned long long> & codes);
+
+		static bool _is_stopped(std::chrono::steady_clock::time_point deadline);
+
+		int _squares;
+
+		// Indexed by the number of empty squares, each sorted by code.
+		std::vector<std::vector<unsigned long long> > _codes;
+		std::vector<std::vector<signed char> > _scores;
+};
+
+#endif
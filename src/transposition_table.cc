@@ -20,37 +20,145 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <limits>
-#include <string.h>
+#include <new>
+#include <stdint.h>
 
 #include "transposition_table.hh"
 
-TranspositionTable::Entry* const TranspositionTable::getEntry(unsigned long long key)
+static const size_t CACHE_LINE_SIZE = 64;
+
+TranspositionTable::TranspositionTable(size_t megabytes) :
+	_memory(NULL),
+	_buckets(NULL),
+	_mask(0),
+	_age(0)
+{
+	size_t count = 1;
+
+	while (count * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024)
+		count *= 2;
+
+	this->_memory = new char[count * sizeof(Bucket) + CACHE_LINE_SIZE];
+	this->_buckets = reinterpret_cast<Bucket *>((reinterpret_cast<uintptr_t>(this->_memory) + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1));
+	this->_mask = count - 1;
+
+	for (size_t i = 0; i < count; i++)
+		new (&(this->_buckets[i])) Bucket();
+
+	this->reset();
+}
+
+TranspositionTable::~TranspositionTable()
+{
+	delete[] this->_memory;
+}
+
+bool TranspositionTable::getEntry(unsigned long long key, Entry & entry)
 {
-	Entry *entry = &(this->_table[key % TABLE_SIZE]);
+	Bucket * bucket = &(this->_buckets[key & this->_mask]);
 
-	if (entry->key == key)
+	for (int i = 0; i < BUCKET_SIZE; i++)
 	{
-		return entry;
+		unsigned long long data = bucket->slots[i].data.load(std::memory_order_relaxed);
+		unsigned long long check = bucket->slots[i].key.load(std::memory_order_relaxed);
+
+		if (data && (check ^ data) == key)
+		{
+			_unpack(data, entry);
+			return true;
+		}
 	}
 
-	return NULL;
+	return false;
 }
 
-TranspositionTable::Entry* const TranspositionTable::newEntry(unsigned long long key)
+void TranspositionTable::storeEntry(unsigned long long key, const Entry & entry)
 {
-	Entry *entry = &(this->_table[key % TABLE_SIZE]);
+	Bucket * bucket = &(this->_buckets[key & this->_mask]);
+	Slot * victim = NULL;
+	int victim_value = std::numeric_limits<int>::max();
+
+	// Reuse the slot already holding this key if there is one. Otherwise, an
+	// empty slot is taken first, then entries left over from earlier searches,
+	// and finally the entry searched to the shallowest depth.
+	for (int i = 0; i < BUCKET_SIZE; i++)
+	{
+		Slot * slot = &(bucket->slots[i]);
 
-	entry->key = key;
-	entry->lowerBound = std::numeric_limits<int>::min();
-	entry->upperBound = std::numeric_limits<int>::max();
-	entry->ply = -1;
-	entry->bestMove = NULL;
+		unsigned long long data = slot->data.load(std::memory_order_relaxed);
+		unsigned long long check = slot->key.load(std::memory_order_relaxed);
+
+		if (!data || (check ^ data) == key)
+		{
+			victim = slot;
+			break;
+		}
+
+		int ply = static_cast<int>((data >> 16) & 0xFF);
+		int age = static_cast<int>((data >> 32) & 0xFF);
+		int value = ply + (age == this->_age ? 256 : 0);
+
+		if (value < victim_value)
+		{
+			victim = slot;
+			victim_value = value;
+		}
+	}
 
-	return entry;
+	unsigned long long data = _pack(entry, this->_age);
+
+	victim->key.store(key ^ data, std::memory_order_relaxed);
+	victim->data.store(data, std::memory_order_relaxed);
+}
+
+void TranspositionTable::newSearch()
+{
+	this->_age = (this->_age + 1) & 0xFF;
 }
 
 void TranspositionTable::reset()
 {
-	memset(this->_table, 0, TABLE_SIZE * sizeof(Entry));
+	for (unsigned long long i = 0; i <= this->_mask; i++)
+	{
+		for (int j = 0; j < BUCKET_SIZE; j++)
+		{
+			this->_buckets[i].slots[j].key.store(0, std::memory_order_relaxed);
+			this->_buckets[i].slots[j].data.store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+unsigned long long TranspositionTable::_pack(const Entry & entry, int age)
+{
+	// Scores only range over -10 to 10, so a byte is plenty. The extreme byte
+	// values stand in for the unbounded ends of the search window.
+	int8_t lower = static_cast<int8_t>(std::max(entry.lowerBound, -128));
+	int8_t upper = static_cast<int8_t>(std::min(entry.upperBound, 127));
+
+	unsigned long long data = 0;
+
+	data |= static_cast<unsigned long long>(static_cast<uint8_t>(lower));
+	data |= static_cast<unsigned long long>(static_cast<uint8_t>(upper)) << 8;
+	data |= static_cast<unsigned long long>(entry.ply & 0xFF) << 16;
+	data |= static_cast<unsigned long long>(entry.bestMove & 0xFF) << 24;
+	data |= static_cast<unsigned long long>(age & 0xFF) << 32;
+
+	// Set a marker bit so that a stored entry is never mistaken for an empty slot.
+	data |= 1ULL << 63;
+
+	return data;
+}
+
+void TranspositionTable::_unpack(unsigned long long data, Entry & entry)
+{
+	int8_t lower = static_cast<int8_t>(data & 0xFF);
+	int8_t upper = static_cast<int8_t>((data >> 8) & 0xFF);
+	int best_move = static_cast<int>((data >> 24) & 0xFF);
+
+	entry.lowerBound = lower == -128 ? std::numeric_limits<int>::min() : lower;
+	entry.upperBound = upper == 127 ? std::numeric_limits<int>::max() : upper;
+	entry.ply = static_cast<int>((data >> 16) & 0xFF);
+	entry.bestMove = best_move == 0xFF ? NO_MOVE : best_move;
 }
@@ -23,38 +23,79 @@
 #ifndef TRIPLETRIAD_TRANSPOSITION_TABLE_HH
 #define TRIPLETRIAD_TRANSPOSITION_TABLE_HH
 
-class Move;
+#include <atomic>
+#include <cstddef>
 
+// The table may be shared between search threads. Entries are written and read
+// without locks; a reader that races with a writer sees a key that does not
+// verify and treats the entry as missing.
 class TranspositionTable
 {
 	public:
-		// A public struct representing the entries in the table. It's public so that
-		// external classes can directly access the entries without needing several
-		// get and set methods (for optimization purposes).
+		// An unpacked copy of an entry in the table. The table itself stores
+		// entries in a packed form, so callers read and write these instead of
+		// touching the table directly.
 		struct Entry
 		{
-			unsigned long long key;
 			int lowerBound;
 			int upperBound;
 			int ply;
-			Move *bestMove;
+			int bestMove;
 		};
 
-		// Retrieve an entry from the table.
-		Entry* const getEntry(unsigned long long key);
+		// Value of Entry::bestMove when no move is known.
+		static const int NO_MOVE = -1;
 
-		// Reset a particular entry, and return the entry.
-		Entry* const newEntry(unsigned long long key);
+		// Create a table using (at most) the given number of megabytes.
+		TranspositionTable(size_t megabytes);
+		~TranspositionTable();
+
+		// Retrieve an entry from the table. Returns false if the key is not present.
+		bool getEntry(unsigned long long key, Entry & entry);
+
+		// Store an entry in the table, replacing the least useful entry in its bucket.
+		void storeEntry(unsigned long long key, const Entry & entry);
+
+		// Mark the start of a new search, so that older entries are replaced first.
+		// This must not be called while a search is using the table.
+		void newSearch();
 
 		// Reset the table.
 		void reset();
 
 	private:
-		// The size of the table.
-		static const int TABLE_SIZE = 1048575;
+		TranspositionTable(const TranspositionTable &);
+		TranspositionTable & operator=(const TranspositionTable &);
+
+		// A packed entry. The data word holds the bounds, ply, best move and age
+		// in one byte each. The key word holds the key XORed with the data word,
+		// so that a key and data word from two different stores never verify.
+		struct Slot
+		{
+			std::atomic<unsigned long long> key;
+			std::atomic<unsigned long long> data;
+		};
+
+		// The number of entries sharing a bucket. A bucket fills one cache line.
+		static const int BUCKET_SIZE = 4;
+
+		struct Bucket
+		{
+			Slot slots[BUCKET_SIZE];
+		};
+
+		static unsigned long long _pack(const Entry & entry, int age);
+		static void _unpack(unsigned long long data, Entry & entry);
+
+		// The memory allocated for the table, and the aligned buckets within it.
+		char * _memory;
+		Bucket * _buckets;
+
+		// The number of buckets minus one. The number of buckets is a power of two.
+		unsigned long long _mask;
 
-		// The actual array that holds the table.
-		Entry _table[TABLE_SIZE];
+		// The age of the current search.
+		int _age;
 };
 
 #endif
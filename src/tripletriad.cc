@@ -20,6 +20,8 @@
  * SOFTWARE.
  */
 
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <list>
@@ -29,6 +31,7 @@
 #include "game_board.hh"
 #include "move.hh"
 #include "player.hh"
+#include "solver_context.hh"
 #include "square.hh"
 
 #include "tripletriad.hh"
@@ -79,6 +82,21 @@ static Element parse_element(char ch)
 	return element;
 }
 
+static const char * outcome_name(Outcome outcome)
+{
+	switch (outcome)
+	{
+		case OUTCOME_WIN:
+			return "Win";
+
+		case OUTCOME_LOSS:
+			return "Loss";
+
+		default:
+			return "Draw";
+	}
+}
+
 std::shared_ptr<TripleTriad> TripleTriad::_instance = std::shared_ptr<TripleTriad>();
 
 TripleTriad::TripleTriad(const std::string & filename) :
@@ -160,10 +178,14 @@ std::shared_ptr<TripleTriad> TripleTriad::get_instance(const std::string & filen
 	return TripleTriad::_instance;
 }
 
-void TripleTriad::run()
+void TripleTriad::run(const SearchOptions & options)
 {
-	Player *firstPlayer = new Player(std::shared_ptr<GameBoard>(this->_gameBoard), PIECE_BLUE, PIECE_RED);
-	Player *secondPlayer = new Player(std::shared_ptr<GameBoard>(this->_gameBoard), PIECE_RED, PIECE_BLUE);
+	// Both players search with the same table, so whatever one has solved the
+	// other can use.
+	std::shared_ptr<SolverContext> context(new SolverContext(options.hash_megabytes));
+
+	Player *firstPlayer = new Player(std::shared_ptr<GameBoard>(this->_gameBoard), context, PIECE_BLUE, PIECE_RED, options);
+	Player *secondPlayer = new Player(std::shared_ptr<GameBoard>(this->_gameBoard), context, PIECE_RED, PIECE_BLUE, options);
 
 	bool blue_human = false;
 	bool red_human = true;
@@ -179,6 +201,13 @@ void TripleTriad::run()
 			this->_gameBoard->move(move);
 
 			std::cout << "Time taken: " << ((SDL_GetTicks() - start) / 1000.0) << "s" << std::endl;
+
+			if (options.wdl)
+				std::cout << "Expected outcome: " << outcome_name(firstPlayer->get_outcome()) << std::endl;
+
+			// Work out the answer to each of the human's replies while they think.
+			if (red_human)
+				firstPlayer->start_pondering();
 		}
 		else if (!red_human && this->_gameBoard->get_current_piece() == PIECE_RED)
 		{
@@ -187,6 +216,13 @@ void TripleTriad::run()
 			this->_gameBoard->move(move);
 
 			std::cout << "Time taken: " << ((SDL_GetTicks() - start) / 1000.0) << "s" << std::endl;
+
+			if (options.wdl)
+				std::cout << "Expected outcome: " << outcome_name(secondPlayer->get_outcome()) << std::endl;
+
+			// Work out the answer to each of the human's replies while they think.
+			if (blue_human)
+				secondPlayer->start_pondering();
 		}
 		else
 		{
@@ -301,14 +337,86 @@ int main(int argc, char* argv[])
 		SDL_Quit();
 	}
 
-	if (argc < 2)
+	SearchOptions options;
+	const char * filename = NULL;
+	bool valid = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--hash-mb") == 0 && i + 1 < argc)
+		{
+			int megabytes = atoi(argv[++i]);
+
+			if (megabytes < 1)
+				valid = false;
+			else
+				options.hash_megabytes = megabytes;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			int threads = atoi(argv[++i]);
+
+			if (threads < 1)
+				valid = false;
+			else
+				options.threads = threads;
+		}
+		else if (strcmp(argv[i], "--split-depth") == 0 && i + 1 < argc)
+		{
+			int split_depth = atoi(argv[++i]);
+
+			if (split_depth < 0)
+				valid = false;
+			else
+				options.split_depth = split_depth;
+		}
+		else if (strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc)
+		{
+			int time_limit = atoi(argv[++i]);
+
+			if (time_limit < 0)
+				valid = false;
+			else
+				options.time_limit = time_limit;
+		}
+		else if (strcmp(argv[i], "--tablebase") == 0 && i + 1 < argc)
+		{
+			int squares = atoi(argv[++i]);
+
+			if (squares < 0 || squares > 9)
+				valid = false;
+			else
+				options.tablebase_squares = squares;
+		}
+		else if (strcmp(argv[i], "--wdl") == 0)
+		{
+			options.wdl = true;
+		}
+		else if (strcmp(argv[i], "--search") == 0 && i + 1 < argc)
+		{
+			const char * driver = argv[++i];
+
+			if (strcmp(driver, "alphabeta") == 0)
+				options.driver = DRIVER_ALPHA_BETA;
+			else if (strcmp(driver, "mtdf") == 0)
+				options.driver = DRIVER_MTDF;
+			else
+				valid = false;
+		}
+		else
+		{
+			filename = argv[i];
+		}
+	}
+
+	if (!filename || !valid)
 	{
-		std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " [--hash-mb <megabytes>] [--threads <count>] [--split-depth <ply>] [--search alphabeta|mtdf] [--time-limit <milliseconds>] [--tablebase <squares>] [--wdl] <filename>" << std::endl;
 		exit(1);
 	}
 
-	std::shared_ptr<TripleTriad> tripletriad = TripleTriad::get_instance(std::string(argv[1]));
-	tripletriad->run();
+	std::shared_ptr<TripleTriad> tripletriad = TripleTriad::get_instance(std::string(filename));
+	tripletriad->run(options);
 
 	return 0;
 }
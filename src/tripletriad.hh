@@ -28,6 +28,7 @@
 #include "SDL.h"
 
 class GameBoard;
+struct SearchOptions;
 
 class TripleTriad
 {
@@ -37,7 +38,7 @@ class TripleTriad
 		static std::shared_ptr<TripleTriad> get_instance(const std::string & filename);
 
 		// Method to run the game.
-		void run();
+		void run(const SearchOptions & options);
 
 		// Method to check SDL events.
 		bool checkEvent(bool moveHuman);
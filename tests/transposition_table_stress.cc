@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2010 Jason Lynch <jason@calindora.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Hammers one small table from many threads at once. Every entry stored is
+// worked out from its key, so a reader that gets back anything else for a key
+// has seen a torn entry: a key word from one store with the data word of
+// another. The table promises those never verify.
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "transposition_table.hh"
+
+static const int THREADS = 8;
+static const int OPERATIONS = 1000000;
+static const int KEYS = 1000;
+static const int BUCKETS = 16;
+
+static TranspositionTable::Entry get_expected_entry(unsigned long long key)
+{
+	TranspositionTable::Entry entry;
+	entry.lowerBound = static_cast<int>(key >> 40 & 0xF) % 11 * 2 - 10;
+	entry.upperBound = entry.lowerBound + static_cast<int>(key >> 44 & 0x3) * 2;
+	entry.ply = static_cast<int>(key >> 48 & 0xF) % 10;
+	entry.bestMove = static_cast<int>(key >> 52 & 0x7F) % 90;
+
+	return entry;
+}
+
+static void hammer(TranspositionTable & table, int thread, std::atomic<long> & hits, std::atomic<long> & torn)
+{
+	// A cheap generator per thread, so the threads do not share any state but
+	// the table.
+	unsigned long long state = 0x9E3779B97F4A7C15ULL * (thread + 1);
+
+	for (int i = 0; i < OPERATIONS; i++)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+
+		// The low bits pick the bucket, so the keys all crowd into a few of
+		// them and keep taking each other's slots.
+		unsigned long long index = state % KEYS;
+		unsigned long long key = (index + 1) * 0xD6E8FEB86659FD93ULL << 16 | index % BUCKETS;
+		TranspositionTable::Entry expected = get_expected_entry(key);
+
+		if (state >> 63)
+		{
+			table.storeEntry(key, expected);
+			continue;
+		}
+
+		TranspositionTable::Entry entry;
+
+		if (!table.getEntry(key, entry))
+			continue;
+
+		hits++;
+
+		if (entry.lowerBound != expected.lowerBound || entry.upperBound != expected.upperBound || entry.ply != expected.ply || entry.bestMove != expected.bestMove)
+			torn++;
+	}
+}
+
+int main()
+{
+	TranspositionTable table(1);
+
+	std::atomic<long> hits(0);
+	std::atomic<long> torn(0);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < THREADS; i++)
+		threads.push_back(std::thread(hammer, std::ref(table), i, std::ref(hits), std::ref(torn)));
+
+	for (auto thread = threads.begin(); thread != threads.end(); thread++)
+		thread->join();
+
+	std::cout << "Hits: " << hits << "   Torn: " << torn << std::endl;
+
+	// Without any hits, nothing was tested.
+	return hits > 0 && torn == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}